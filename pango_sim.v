@@ -78,6 +78,28 @@ module GTP_LUT6
 $lut #(.WIDTH(6),.LUT(INIT)) lut1_cell(.A({I5,I4,I3,I2,I1,I0}),.Y(Z));
 endmodule
 
+module GTP_LUT7
+#(
+    parameter [127:0] INIT = 128'h0
+) (
+    output wire Z,
+    input wire I0, I1, I2, I3, I4, I5, I6
+);
+
+$lut #(.WIDTH(7),.LUT(INIT)) lut1_cell(.A({I6,I5,I4,I3,I2,I1,I0}),.Y(Z));
+endmodule
+
+module GTP_LUT8
+#(
+    parameter [255:0] INIT = 256'h0
+) (
+    output wire Z,
+    input wire I0, I1, I2, I3, I4, I5, I6, I7
+);
+
+$lut #(.WIDTH(8),.LUT(INIT)) lut1_cell(.A({I7,I6,I5,I4,I3,I2,I1,I0}),.Y(Z));
+endmodule
+
 
 module GTP_LUT6D
 #(
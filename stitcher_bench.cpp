@@ -0,0 +1,128 @@
+//g++ -std=c++17 -O2 -fopenmp -o stitcher_bench stitcher_bench.cpp
+// 离线测试 stitcher 的候选搜索和规划，不需要运行 yosys。
+// 先在 yosys 中用 stitcher -dump-bin <file> 导出交给候选搜索的LUT，再运行：
+//   ./stitcher_bench <file> [repeat]
+// 依次执行共享输入搜索 (SharedNetIndex)、LUT6 吸收搜索 (AbsorbIndex)、候选排序 (SortCandidates) 和贪心规划 (PlanMerges)，
+// 打印各步耗时和合并数。
+// 与 stitcher 的全局搜索路径一致；超过 LAYERED_SEARCH_THRESHOLD 的设计在 stitcher 中会改用分层搜索，这里不做分层。
+#include "stitcher_core.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 用 mmap 读取 -dump-bin 文件，失败时打印原因并返回 false
+bool LoadLutDump(const char *filename, std::vector<LutInfo> &luts, size_t &num_nets)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		perror(filename);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LutDumpHeader)) {
+		fprintf(stderr, "%s: file too small\n", filename);
+		close(fd);
+		return false;
+	}
+	void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		perror("mmap");
+		return false;
+	}
+
+	const LutDumpHeader *header = static_cast<const LutDumpHeader *>(data);
+	bool ok = memcmp(header->magic, LUT_DUMP_MAGIC, 4) == 0 && header->version == LUT_DUMP_VERSION &&
+		  (size_t)st.st_size == sizeof(LutDumpHeader) + (size_t)header->num_luts * sizeof(LutRecord);
+	if (!ok) {
+		fprintf(stderr, "%s: not a version %u LUT dump\n", filename, LUT_DUMP_VERSION);
+	} else {
+		const LutRecord *records = reinterpret_cast<const LutRecord *>(header + 1);
+		luts.resize(header->num_luts);
+		for (size_t i = 0; i < luts.size() && ok; ++i) {
+			// 截断或过期的文件中 size 和信号编号可能越界，搜索时会越界访问
+			ok = records[i].size >= 1 && records[i].size <= 6 && records[i].output < header->num_nets;
+			for (uint32_t k = 0; k < records[i].size && ok; ++k)
+				ok = records[i].inputs[k] < header->num_nets;
+			if (!ok) {
+				fprintf(stderr, "%s: LUT record %zu has size %u or a net id out of range (%u nets)\n", filename, i, records[i].size,
+					header->num_nets);
+				break;
+			}
+			luts[i].size = records[i].size;
+			std::copy(records[i].inputs, records[i].inputs + 6, luts[i].inputs);
+			luts[i].output = records[i].output;
+			luts[i].init = records[i].init;
+		}
+		num_nets = header->num_nets;
+	}
+	munmap(data, st.st_size);
+	return ok;
+}
+
+double SecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <lut dump from stitcher -dump-bin> [repeat]\n", argv[0]);
+		return 1;
+	}
+	int repeat = argc > 2 ? std::max(atoi(argv[2]), 1) : 1;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<LutInfo> luts;
+	size_t num_nets = 0;
+	if (!LoadLutDump(argv[1], luts, num_nets))
+		return 1;
+	printf("Loaded %zu LUTs over %zu nets in %.3f s\n", luts.size(), num_nets, SecondsSince(start));
+
+	for (int run = 0; run < repeat; ++run) {
+		for (auto &lut : luts)
+			lut.is_merged = false;
+		std::vector<MergeCandidate> candidates;
+
+		// 共享输入搜索
+		start = std::chrono::high_resolution_clock::now();
+		SharedNetIndex net_index(luts, num_nets);
+		size_t visited_pairs = net_index.for_each_pair([&](int i, int j) { check_and_add_candidates(luts, i, j, candidates); });
+		double search_seconds = SecondsSince(start);
+		size_t shared_candidates = candidates.size();
+
+		// LUT6 吸收搜索
+		start = std::chrono::high_resolution_clock::now();
+		AbsorbIndex absorb_index(luts);
+		for (size_t i = 0; i < luts.size(); ++i)
+			absorb_index.find(luts, i, [&](const MergeCandidate &cand) { candidates.push_back(cand); });
+		double absorb_seconds = SecondsSince(start);
+
+		// 排序
+		start = std::chrono::high_resolution_clock::now();
+		SortCandidates(candidates);
+		double sort_seconds = SecondsSince(start);
+
+		// 贪心规划
+		start = std::chrono::high_resolution_clock::now();
+		std::vector<MergePlan> plans = PlanMerges(luts, candidates);
+		double plan_seconds = SecondsSince(start);
+
+		printf("Run %d:\n", run + 1);
+		printf("  shared-input search: %.3f s, %zu pairs visited, %zu candidates\n", search_seconds, visited_pairs, shared_candidates);
+		printf("  LUT6 absorb search:  %.3f s, %zu candidates\n", absorb_seconds, candidates.size() - shared_candidates);
+		printf("  sort candidates:     %.3f s\n", sort_seconds);
+		printf("  greedy planning:     %.3f s\n", plan_seconds);
+		printf("  total:               %.3f s, %zu merges, %zu -> %zu LUTs\n", search_seconds + absorb_seconds + sort_seconds + plan_seconds,
+		       plans.size(), luts.size(), luts.size() - plans.size());
+	}
+	return 0;
+}
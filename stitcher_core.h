@@ -0,0 +1,531 @@
+// stitcher 的核心数据结构和算法：LUT 记录、候选对、余因子索引、共享输入索引和合并计划。
+// 这里只依赖标准库，stitcher_pango.cc 和离线基准程序 stitcher_bench.cpp 共用同一份实现。
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace Yosys
+{
+namespace RTLIL
+{
+struct Cell;
+}
+} // namespace Yosys
+
+namespace
+{
+
+// 信号编号 0 和 1 固定为常数 0 和常数 1，CollectLuts 最先登记这两个信号
+const uint32_t CONST0_NET = 0;
+const uint32_t CONST1_NET = 1;
+
+// 全局搜索中，高扇出信号（复位、使能等）的每个读者最多与其后多少个读者配对
+const size_t MAX_NET_FANOUT_PAIRS = 64;
+
+// 紧凑的 LUT 记录：按端口 I0..I5 顺序保存输入信号编号，真值表打包为 64 位（只有低 2^size 位有效）
+struct LutInfo {
+	Yosys::RTLIL::Cell *cell_ptr = nullptr;
+	int size = 0;
+	uint32_t inputs[6] = {};
+	uint32_t output = 0;
+	uint64_t init = 0;
+	bool is_merged = false;
+	bool is_shrunk = false; // 被 FoldConstantInputs / ShrinkLutSupport 去掉过输入
+
+	bool has_input(uint32_t net) const
+	{
+		for (int k = 0; k < size; ++k)
+			if (inputs[k] == net)
+				return true;
+		return false;
+	}
+};
+
+enum class MergeType : uint8_t {
+	SHARED_INPUTS, // 总输入<=5
+	LUT6_ABSORB    // LUT6吸收小LUT
+};
+
+// 候选对只保存 16 字节，合并后的输入集合在 PlanMerges 接受该候选时再重新计算
+struct MergeCandidate {
+	int idx_a, idx_b;
+	int score;
+
+	MergeType type;
+	uint8_t sel_port; // 仅在 LUT6_ABSORB 类型下有效：sel_bit 是 idx_a (LUT6) 的第几个输入
+
+	bool operator<(const MergeCandidate &other) const { return score < other.score; }
+};
+static_assert(sizeof(MergeCandidate) == 16, "MergeCandidate should stay 16 bytes");
+
+// 按分数从高到低排序，分数相同时按LUT序号排序，保证结果与线程调度无关
+bool higher_score(const MergeCandidate &a, const MergeCandidate &b)
+{
+	if (a.score != b.score)
+		return a.score > b.score;
+	if (a.idx_a != b.idx_a)
+		return a.idx_a < b.idx_a;
+	return a.idx_b < b.idx_b;
+}
+
+// 按 higher_score 排序。开启 OpenMP 时每个线程先排序一段，再逐轮两两归并相邻的段；
+// busy_seconds 非空时记录各线程在这些并行循环中的忙碌时间（下标为线程号）
+void SortCandidates(std::vector<MergeCandidate> &candidates, std::vector<double> *busy_seconds = nullptr)
+{
+#ifdef _OPENMP
+	int num_chunks = omp_get_max_threads();
+#else
+	int num_chunks = 1;
+#endif
+	if (busy_seconds)
+		busy_seconds->assign(num_chunks, 0.0);
+	std::vector<size_t> bounds(num_chunks + 1);
+	for (int c = 0; c <= num_chunks; ++c)
+		bounds[c] = candidates.size() * c / num_chunks;
+	auto record_busy = [&](std::chrono::high_resolution_clock::time_point start) {
+		if (!busy_seconds)
+			return;
+#ifdef _OPENMP
+		int thread_id = omp_get_thread_num();
+#else
+		int thread_id = 0;
+#endif
+		(*busy_seconds)[thread_id] += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+	auto begin = candidates.begin();
+#pragma omp parallel for schedule(static, 1)
+	for (int c = 0; c < num_chunks; ++c) {
+		auto start = std::chrono::high_resolution_clock::now();
+		std::sort(begin + bounds[c], begin + bounds[c + 1], higher_score);
+		record_busy(start);
+	}
+	for (int width = 1; width < num_chunks; width *= 2) {
+#pragma omp parallel for schedule(static, 1)
+		for (int c = 0; c < num_chunks - width; c += 2 * width) {
+			auto start = std::chrono::high_resolution_clock::now();
+			std::inplace_merge(begin + bounds[c], begin + bounds[c + width], begin + bounds[std::min(c + 2 * width, num_chunks)],
+					   higher_score);
+			record_busy(start);
+		}
+	}
+}
+
+// 两个LUT输入的并集：先是 lut_a 的输入，再是 lut_b 独有的输入，返回并集大小
+int get_union_inputs(const LutInfo &lut_a, const LutInfo &lut_b, uint32_t union_inputs[12])
+{
+	int union_size = 0;
+	for (int k = 0; k < lut_a.size; ++k)
+		union_inputs[union_size++] = lut_a.inputs[k];
+	for (int k = 0; k < lut_b.size; ++k)
+		if (!lut_a.has_input(lut_b.inputs[k]))
+			union_inputs[union_size++] = lut_b.inputs[k];
+	return union_size;
+}
+
+#pragma region complex_case_funcs
+// 模板掩码：第 k 个输入为 1 的真值表位置
+const uint64_t INPUT_MASKS[] = {
+  0xAAAAAAAAAAAAAAAA, // I0
+  0xCCCCCCCCCCCCCCCC, // I1
+  0xF0F0F0F0F0F0F0F0, // I2
+  0xFF00FF00FF00FF00, // I3
+  0xFFFF0000FFFF0000, // I4
+  0xFFFFFFFF00000000  // I5
+};
+
+// 把 size 输入的真值表复制填满 64 位，未使用的高位输入就成了无关变量
+uint64_t expand_truth_table(uint64_t tt, int size)
+{
+	for (int k = size; k < 6; ++k)
+		tt |= tt << (1 << k);
+	return tt;
+}
+
+// 第 k 个输入取 0 时的负余因子，结果仍是 64 位真值表，且不再依赖第 k 个输入
+uint64_t negative_cofactor(uint64_t tt, int k)
+{
+	uint64_t low = tt & ~INPUT_MASKS[k];
+	return low | (low << (1 << k));
+}
+
+bool depends_on_input(uint64_t tt, int k) { return negative_cofactor(tt, k) != (((tt & INPUT_MASKS[k]) >> (1 << k)) | (tt & INPUT_MASKS[k])); }
+
+// 与输入顺序无关的函数签名：真实支撑集的信号编号（升序）及按此顺序排列的真值表
+struct CofactorKey {
+	uint32_t nets[5];
+	int size;
+	uint32_t tt;
+
+	bool operator==(const CofactorKey &other) const
+	{
+		return size == other.size && tt == other.tt && std::equal(nets, nets + size, other.nets);
+	}
+};
+
+struct CofactorKeyHash {
+	size_t operator()(const CofactorKey &key) const
+	{
+		uint64_t h = key.tt * 0x9E3779B97F4A7C15ULL + key.size;
+		for (int k = 0; k < key.size; ++k)
+			h = (h ^ key.nets[k]) * 0x100000001B3ULL;
+		return h;
+	}
+};
+
+// tt64 是以 nets[0..5] 为输入的 64 位真值表，支撑集超过 5 个输入时返回 false
+bool make_cofactor_key(uint64_t tt64, const uint32_t nets[6], CofactorKey &key)
+{
+	int support[6];
+	key.size = 0;
+	for (int k = 0; k < 6; ++k) {
+		if (depends_on_input(tt64, k)) {
+			if (key.size == 5)
+				return false;
+			support[key.size++] = k;
+		}
+	}
+	// 按信号编号插入排序，最多 5 个元素
+	for (int i = 1; i < key.size; ++i) {
+		int k = support[i];
+		int j = i;
+		for (; j > 0 && nets[support[j - 1]] > nets[k]; --j)
+			support[j] = support[j - 1];
+		support[j] = k;
+	}
+	key.tt = 0;
+	for (int m = 0; m < (1 << key.size); ++m) {
+		int addr = 0;
+		for (int idx = 0; idx < key.size; ++idx)
+			if ((m >> idx) & 1)
+				addr |= 1 << support[idx];
+		key.tt |= uint32_t((tt64 >> addr) & 1) << m;
+	}
+	for (int idx = 0; idx < key.size; ++idx)
+		key.nets[idx] = nets[support[idx]];
+	return true;
+}
+
+// LUT6 吸收小 LUT：GTP_LUT6D 的 Z5 输出恒为 INIT[31:0]，即 I5=0 的那一半，所以小 LUT 的函数必须等于
+// LUT6 对某个输入 (sel_bit，接到 I5) 的负余因子。对每个 LUT6 的每个输入计算负余因子的签名并建立哈希索引，
+// 小 LUT 按同样的方式计算签名后 O(1) 查找。正余因子放不到 Z5 上，所以不进索引。
+struct AbsorbIndex {
+	std::unordered_map<CofactorKey, std::vector<std::pair<int, int>>, CofactorKeyHash> cofactors; // 签名 -> (LUT6 序号, sel_bit 端口)
+
+	AbsorbIndex(const std::vector<LutInfo> &luts)
+	{
+		for (size_t i = 0; i < luts.size(); ++i) {
+			if (luts[i].size != 6)
+				continue;
+			for (int k = 0; k < 6; ++k) {
+				CofactorKey key;
+				if (make_cofactor_key(negative_cofactor(luts[i].init, k), luts[i].inputs, key))
+					cofactors[key].push_back({(int)i, k});
+			}
+		}
+	}
+
+	// 查找能吸收 luts[idx_s] 的 LUT6，候选的 idx_a 为 LUT6，idx_b 为小 LUT
+	template <typename Visitor> void find(const std::vector<LutInfo> &luts, int idx_s, Visitor visit) const
+	{
+		const LutInfo &lut_s = luts[idx_s];
+		if (lut_s.size >= 6)
+			return;
+		uint32_t nets[6] = {};
+		std::copy(lut_s.inputs, lut_s.inputs + lut_s.size, nets);
+		CofactorKey key;
+		if (!make_cofactor_key(expand_truth_table(lut_s.init, lut_s.size), nets, key))
+			return;
+		auto it = cofactors.find(key);
+		if (it == cofactors.end())
+			return;
+		for (const auto &[idx_6, sel_port] : it->second) {
+			const LutInfo &lut_6 = luts[idx_6];
+			// 小 LUT 的所有输入都必须是 LUT6 除 sel_bit 外的输入，且其输出不能是 LUT6 的输入（避免自环）
+			bool fits = !lut_6.has_input(lut_s.output);
+			for (int k = 0; k < lut_s.size && fits; ++k)
+				fits = lut_s.inputs[k] != lut_6.inputs[sel_port] && lut_6.has_input(lut_s.inputs[k]);
+			if (fits)
+				visit(MergeCandidate{idx_6, idx_s, 10000 + lut_s.size * 100, MergeType::LUT6_ABSORB, (uint8_t)sel_port});
+		}
+	}
+};
+#pragma endregion complex_case_funcs
+
+// =================================================================
+// 新的、独立的辅助函数，用于检查一对LUT的所有合并可能性
+// =================================================================
+void check_and_add_candidates(const std::vector<LutInfo> &luts, int idx_a, int idx_b, std::vector<MergeCandidate> &local_candidates)
+{
+	const LutInfo &lut_a = luts[idx_a];
+	const LutInfo &lut_b = luts[idx_b];
+
+	// --- 逻辑 1: 检查 SHARED_INPUTS 类型的合并 (来自旧的 check_shared_inputs) ---
+	uint32_t current_union_inputs[12];
+	int union_size = get_union_inputs(lut_a, lut_b, current_union_inputs);
+
+	if (union_size <= 5) {
+		int shared_inputs = (lut_a.size + lut_b.size) - union_size;
+		if (shared_inputs >= 1) {
+			int score = shared_inputs * 100 - union_size;
+			local_candidates.push_back({idx_a, idx_b, score, MergeType::SHARED_INPUTS, 0});
+		}
+	}
+
+	// LUT6_ABSORB 类型的合并不需要成对检查，由 AbsorbIndex 按余因子签名直接查找
+}
+
+// 只有共享至少一个输入的两个LUT才可能合并，所以先建立 输入信号 -> 读取它的LUT 的倒排索引，
+// 只在同一个信号的读者之间配对，搜索量从 N^2 降为各信号扇出之和
+struct SharedNetIndex {
+	std::vector<std::vector<int>> net_to_luts;
+	std::vector<std::vector<std::pair<const std::vector<int> *, size_t>>> lut_positions; // 每个LUT在各输入信号读者列表中的位置
+	size_t used_nets = 0;
+	size_t capped_nets = 0;
+
+	SharedNetIndex(const std::vector<LutInfo> &luts, size_t num_nets) : net_to_luts(num_nets), lut_positions(luts.size())
+	{
+		for (size_t i = 0; i < luts.size(); ++i) {
+			for (int k = 0; k < luts[i].size; ++k) {
+				std::vector<int> &readers = net_to_luts[luts[i].inputs[k]];
+				if (readers.empty() || readers.back() != (int)i)
+					readers.push_back(i);
+			}
+		}
+		for (const auto &readers : net_to_luts) {
+			for (size_t pos = 0; pos < readers.size(); ++pos)
+				lut_positions[readers[pos]].push_back({&readers, pos});
+			used_nets += !readers.empty();
+			// 复位、使能等高扇出信号的读者很多，每个读者只与列表中其后 MAX_NET_FANOUT_PAIRS 个读者配对
+			if (readers.size() > MAX_NET_FANOUT_PAIRS + 1)
+				capped_nets++;
+		}
+	}
+
+	// 对每一对共享输入的LUT (i < j) 调用一次 visit，返回访问的LUT对数
+	template <typename Visitor> size_t for_each_pair(Visitor visit) const
+	{
+		std::vector<int> last_visited(lut_positions.size(), -1); // 去重：同一对LUT可能通过多个共享信号被访问到
+		size_t visited_pairs = 0;
+		for (size_t i = 0; i < lut_positions.size(); ++i) {
+			for (const auto &[readers, pos] : lut_positions[i]) {
+				size_t end = std::min(readers->size(), pos + 1 + MAX_NET_FANOUT_PAIRS);
+				for (size_t k = pos + 1; k < end; ++k) {
+					int j = (*readers)[k];
+					if (last_visited[j] == (int)i)
+						continue;
+					last_visited[j] = i;
+					visited_pairs++;
+					visit((int)i, j);
+				}
+			}
+		}
+		return visited_pairs;
+	}
+
+	// 只访问至少包含一个 active LUT 的LUT对，访问窗口与 for_each_pair 相同（读者列表中前后各 MAX_NET_FANOUT_PAIRS 个）
+	template <typename Visitor> size_t for_each_pair_around(const std::vector<char> &active, Visitor visit) const
+	{
+		std::vector<int> last_visited(lut_positions.size(), -1);
+		size_t visited_pairs = 0;
+		for (size_t i = 0; i < lut_positions.size(); ++i) {
+			if (!active[i])
+				continue;
+			last_visited[i] = i;
+			for (const auto &[readers, pos] : lut_positions[i]) {
+				size_t begin = pos > MAX_NET_FANOUT_PAIRS ? pos - MAX_NET_FANOUT_PAIRS : 0;
+				size_t end = std::min(readers->size(), pos + 1 + MAX_NET_FANOUT_PAIRS);
+				for (size_t k = begin; k < end; ++k) {
+					int j = (*readers)[k];
+					// 两个都是 active 的LUT对由序号较小的一方访问
+					if (last_visited[j] == (int)i || (active[j] && j < (int)i))
+						continue;
+					last_visited[j] = i;
+					visited_pairs++;
+					visit(std::min((int)i, j), std::max((int)i, j));
+				}
+			}
+		}
+		return visited_pairs;
+	}
+};
+
+uint64_t calculate_new_init(const LutInfo &lut_a, const LutInfo &lut_b, const uint32_t new_inputs[6], uint32_t sel_bit, uint32_t &z_out_sig,
+			    uint32_t &z5_out_sig)
+{
+	// 正确的逻辑：不包含sel_bit的LUT用于Z5 (sel=0)，包含sel_bit的用于Z (sel=1)
+	const LutInfo &lut_for_z5 = lut_a.has_input(sel_bit) ? lut_b : lut_a;
+	const LutInfo &lut_for_z_sel1 = lut_a.has_input(sel_bit) ? lut_a : lut_b;
+
+	z5_out_sig = lut_for_z5.output;
+	z_out_sig = lut_for_z_sel1.output;
+
+	// 新LUT的 I[4:0] 的每一种组合 i，在原始LUT中对应的地址；sel_value 为 sel_bit 在这一半中的取值
+	auto half_truth_table = [&](const LutInfo &lut, bool sel_value) {
+		int shared_idx[6];
+		for (int k = 0; k < lut.size; ++k) {
+			shared_idx[k] = -1;
+			for (int n = 0; n < 5; ++n) {
+				if (new_inputs[n] == lut.inputs[k]) {
+					shared_idx[k] = n;
+					break;
+				}
+			}
+		}
+		uint64_t bits = 0;
+		for (int i = 0; i < 32; ++i) {
+			size_t addr = 0;
+			for (int k = 0; k < lut.size; ++k) {
+				if (shared_idx[k] >= 0) {
+					if ((i >> shared_idx[k]) & 1)
+						addr |= 1 << k;
+				} else if (sel_value && lut.inputs[k] == sel_bit) {
+					// 当计算Z的逻辑时，sel_bit的值被认为是1
+					addr |= 1 << k;
+				}
+			}
+			bits |= ((lut.init >> addr) & 1) << i;
+		}
+		return bits;
+	};
+
+	// 低 32 位为 Z5 (sel=0)，高 32 位为 Z (sel=1)
+	return half_truth_table(lut_for_z5, false) | (half_truth_table(lut_for_z_sel1, true) << 32);
+}
+
+// =================================================================
+// 步骤 3: 执行合并操作
+// 用于存储合并计划的结构体。计划在同一次运行中生成并执行，期间不会删除任何cell，
+// 所以直接保存要移除的cell指针；新cell的名字在执行时按计数器生成
+// =================================================================
+struct MergePlan {
+	uint64_t init_val;	 // 生成新LUT的真值表
+	uint32_t inputs[6];	 // 生成新LUT的输入信号编号 I0..I5
+	uint32_t z_out, z5_out;	 // 生成新LUT的输出信号编号
+	Yosys::RTLIL::Cell *cell_a;	 // 需要移除的LUT
+	Yosys::RTLIL::Cell *cell_b;	 // 需要移除的LUT
+};
+
+// 为一个已接受的候选对生成合并计划
+MergePlan BuildMergePlan(const std::vector<LutInfo> &luts, const MergeCandidate &best_pair)
+{
+	const LutInfo &lut_a = luts[best_pair.idx_a];
+	const LutInfo &lut_b = luts[best_pair.idx_b];
+
+	uint32_t new_inputs_vec[6];
+	uint32_t sel_bit;
+
+	// --- 【核心修改：根据类型分发】 ---
+	if (best_pair.type == MergeType::SHARED_INPUTS) {
+		// --- 情况一：总输入数 <= 5 ---
+		uint32_t union_inputs[12];
+		int union_size = get_union_inputs(lut_a, lut_b, union_inputs);
+		// 候选生成保证并集不超过 5，这里的检查不受 NDEBUG 影响
+		if (union_size > 5)
+			throw std::logic_error("SHARED_INPUTS merge candidate with more than 5 inputs");
+		// 补齐空输入（当总输入数小于5时）
+		for (int k = 0; k < 5; ++k)
+			new_inputs_vec[k] = k < union_size ? union_inputs[k] : CONST0_NET;
+		// 最后的一位信号为常数1作为sel_bit
+		sel_bit = CONST1_NET;
+		new_inputs_vec[5] = sel_bit;
+	} else { // best_pair.type == MergeType::LUT6_ABSORB
+		// --- 情况二：LUT6 吸收小 LUT ---
+		const LutInfo &lut_6 = lut_a; // 吸收候选的 idx_a 总是 LUT6
+
+		// 1. 新的输入向量就是LUT6的原始输入向量
+		for (int k = 0; k < 6; ++k)
+			new_inputs_vec[k] = lut_6.inputs[k];
+
+		// 2. sel_bit 是之前已经发现并存储好的
+		sel_bit = lut_6.inputs[best_pair.sel_port];
+
+		// 3. 端口映射：确保 sel_bit 在最后一位
+		auto sel_it = std::find(new_inputs_vec, new_inputs_vec + 6, sel_bit);
+		if (sel_it != new_inputs_vec + 6)
+			std::iter_swap(sel_it, new_inputs_vec + 5);
+	}
+
+	// --- 公共逻辑：计算 INIT 并创建规划 ---
+	// 创建一个结构体，保存合并LUT所需要的全部信息
+	MergePlan plan;
+	// 新LUT 结构体真值表和输出
+	plan.init_val = calculate_new_init(lut_a, lut_b, new_inputs_vec, sel_bit, plan.z_out, plan.z5_out);
+	// 新LUT 输入信号
+	std::copy(new_inputs_vec, new_inputs_vec + 6, plan.inputs);
+	// 需要移除的LUT
+	plan.cell_a = lut_a.cell_ptr;
+	plan.cell_b = lut_b.cell_ptr;
+
+	return plan;
+}
+
+// 规划时的统计回调，默认什么也不做；stitcher -stats 用它统计候选、接受和拒绝的合并
+struct PlanListener {
+	virtual ~PlanListener() = default;
+	virtual void on_candidates(const std::vector<MergeCandidate> &) {}
+	virtual void on_accepted(const MergeCandidate &) {}
+	virtual void on_lut_already_merged(const MergeCandidate &) {}
+};
+
+// 贪心规划，只负责规划，返回一个安全的计划列表
+// candidates 已按分数从高到低排好序
+std::vector<MergePlan> PlanMerges(std::vector<LutInfo> &luts, const std::vector<MergeCandidate> &candidates, PlanListener *listener = nullptr)
+{
+	std::vector<MergePlan> plans;
+	if (listener)
+		listener->on_candidates(candidates);
+
+	for (const MergeCandidate &best_pair : candidates) {
+		LutInfo &lut_a = luts[best_pair.idx_a];
+		LutInfo &lut_b = luts[best_pair.idx_b];
+
+		if (lut_a.is_merged || lut_b.is_merged) {
+			if (listener)
+				listener->on_lut_already_merged(best_pair);
+			continue;
+		}
+
+		lut_a.is_merged = true;
+		lut_b.is_merged = true;
+		if (listener)
+			listener->on_accepted(best_pair);
+
+		// 保存规划
+		plans.push_back(BuildMergePlan(luts, best_pair));
+	}
+	return plans;
+}
+
+// =================================================================
+// -dump-bin 的二进制格式：文件头之后是 num_luts 个 LutRecord，全部为本机字节序。
+// 记录的是步骤 1.5 之后、交给候选搜索的LUT；信号编号与 net_bits 一致，0 和 1 为常数。
+// =================================================================
+const char LUT_DUMP_MAGIC[4] = {'P', 'L', 'U', 'T'};
+const uint32_t LUT_DUMP_VERSION = 1;
+
+struct LutDumpHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t num_luts;
+	uint32_t num_nets;
+};
+static_assert(sizeof(LutDumpHeader) == 16, "LutDumpHeader layout is part of the file format");
+
+struct LutRecord {
+	uint64_t init; // 只有低 2^size 位有效
+	uint32_t inputs[6];
+	uint32_t output;
+	uint32_t size;
+};
+static_assert(sizeof(LutRecord) == 40, "LutRecord layout is part of the file format");
+
+} // namespace
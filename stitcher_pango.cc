@@ -6,13 +6,17 @@
 #include "kernel/yosys.h"
 #include <algorithm>
 #include <chrono>
+#include <climits>
 #include <fstream>
 #include <omp.h>
 #include <queue>
 #include <ranges>
 #include <string.h>
+#include <unordered_map>
 #include <vector>
 
+#include "stitcher_core.h"
+
 #define Layered	   // 控制是否启用分层优化
 #define USE_OPENMP // 控制是否开启并行优化
 
@@ -26,6 +30,10 @@ const size_t LAYERED_SEARCH_THRESHOLD = 30000;
 
 const double SEARCH_TIMEOUT_SECONDS = 300.0; // 控制单个搜索进程的超时退出阈值（虽然并行化后没啥必要了）
 
+// -stats 开启时记录每个步骤的耗时和内存，定义见下方统计信息部分
+void ReadStepMemory(long &vm_hwm_kb, long &vm_rss_kb);
+void RecordStepStats(const std::string &task_name, double seconds, long start_hwm_kb, long start_rss_kb);
+
 // =================================================================
 // 计时辅助类
 // =================================================================
@@ -36,6 +44,7 @@ class ScopedTimer
 	ScopedTimer(const std::string &task_name) : task_name_(task_name), start_time_(std::chrono::high_resolution_clock::now())
 	{
 		log("\n--- Timing start: %s ---\n", task_name_.c_str());
+		ReadStepMemory(start_hwm_kb_, start_rss_kb_);
 	}
 
 	// 析构函数：记录结束时间，计算差值，并打印结果
@@ -44,23 +53,36 @@ class ScopedTimer
 		auto end_time = std::chrono::high_resolution_clock::now();
 		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time_).count();
 		log("--- Timing end: %s | Duration: %.3f seconds ---\n", task_name_.c_str(), duration / 1000.0);
+		RecordStepStats(task_name_, duration / 1000.0, start_hwm_kb_, start_rss_kb_);
 	}
 
       private:
 	std::string task_name_;
 	std::chrono::time_point<std::chrono::high_resolution_clock> start_time_;
+	long start_hwm_kb_ = -1, start_rss_kb_ = -1; // 开始时的内存读数，-stats 关闭时不读取
 };
 
-// LutInfo 结构体保持不变
-struct LutInfo {
-	RTLIL::Cell *cell_ptr = nullptr;
-	int size = 0;
-	// 使用 map 来存储有序的、带端口名的输入
-	map<string, SigBit> ordered_inputs;
-	SigBit output;
-	RTLIL::Const init_val;
-	bool is_merged = false;
-};
+// 信号编号表：搜索和规划阶段只使用整数编号，执行合并时再转换回 SigBit
+vector<SigBit> net_bits;
+dict<SigBit, uint32_t> net_ids;
+
+uint32_t GetNetId(const SigBit &bit)
+{
+	auto it = net_ids.find(bit);
+	if (it != net_ids.end())
+		return it->second;
+	net_bits.push_back(bit);
+	return net_ids[bit] = net_bits.size() - 1;
+}
+
+// 64 位真值表转换回 RTLIL 的 INIT 参数
+RTLIL::Const init_to_const(uint64_t init, int width)
+{
+	vector<RTLIL::State> bits;
+	for (int i = 0; i < width; ++i)
+		bits.push_back((init >> i) & 1 ? RTLIL::S1 : RTLIL::S0);
+	return RTLIL::Const(bits);
+}
 
 // 用于按层次存储LUT索引的地图
 map<int, vector<int>> level_to_lut_indices;
@@ -77,7 +99,7 @@ void NumberLutsByLevel(const vector<LutInfo> &luts)
 	// --- 准备工作：建立图的邻接关系和入度表 ---
 	dict<RTLIL::Cell *, pool<RTLIL::Cell *>> lut_graph; // LUT -> set of downstream LUTs
 	dict<RTLIL::Cell *, int> lut_in_degree;
-	dict<RTLIL::SigBit, RTLIL::Cell *> output_sig_to_lut; // 方便快速查找驱动LUT
+	dict<uint32_t, RTLIL::Cell *> output_sig_to_lut; // 方便快速查找驱动LUT
 
 	// 快速查找一个Cell指针是否在我们的LUT列表中
 	pool<RTLIL::Cell *> lut_cell_pool;
@@ -92,8 +114,8 @@ void NumberLutsByLevel(const vector<LutInfo> &luts)
 		lut_in_degree[src_lut.cell_ptr] = 0; // 初始化入度
 
 		// 计算当前LUT的入度 (只考虑来自其他LUT的输入)
-		for (const auto &pair : src_lut.ordered_inputs) {
-			SigBit input_sig = pair.second;
+		for (int k = 0; k < src_lut.size; ++k) {
+			uint32_t input_sig = src_lut.inputs[k];
 			// 检查这个输入是否由另一个LUT驱动
 			if (output_sig_to_lut.count(input_sig)) {
 				RTLIL::Cell *driver_lut_ptr = output_sig_to_lut.at(input_sig);
@@ -212,18 +234,18 @@ string format_init_hex(const RTLIL::Const &init_val)
 void print_lut_info_to_stream(ostream &f, const LutInfo &info)
 {
 	f << "  - Cell: " << log_id(info.cell_ptr->name) << " (Type: " << log_id(info.cell_ptr->type) << ", Size: " << info.size << ")\n";
-	f << "    Output: " << log_signal(info.output) << "\n";
+	f << "    Output: " << log_signal(net_bits[info.output]) << "\n";
 
-	// --- 修改在这里 ---
-	// 遍历有序字典，打印出端口名和对应的信号
+	// 按端口顺序打印端口名和对应的信号
 	f << "    Inputs:\n";
-	for (const auto &pair : info.ordered_inputs) {
-		f << "      ." << pair.first << ": " << log_signal(pair.second) << "\n";
+	for (int k = 0; k < info.size; ++k) {
+		f << "      .I" << k << ": " << log_signal(net_bits[info.inputs[k]]) << "\n";
 	}
 
-	string init_hex_str = format_init_hex(info.init_val);
-	f << "    INIT: " << GetSize(info.init_val) << "'h" << init_hex_str << "\n";
-	f << "    INIT: " << GetSize(info.init_val) << "'b" << info.init_val.as_string() << "\n\n";
+	RTLIL::Const init_val = init_to_const(info.init, 1 << info.size);
+	string init_hex_str = format_init_hex(init_val);
+	f << "    INIT: " << GetSize(init_val) << "'h" << init_hex_str << "\n";
+	f << "    INIT: " << GetSize(init_val) << "'b" << init_val.as_string() << "\n\n";
 }
 
 void dump_luts_to_file(const string &filename, const vector<LutInfo> &luts)
@@ -241,326 +263,447 @@ void dump_luts_to_file(const string &filename, const vector<LutInfo> &luts)
 	f << "--- End of LUT dump ---\n";
 	log("Successfully dumped LUT info to '%s'.\n", filename.c_str());
 }
+
+// 紧凑的二进制格式（见 stitcher_core.h 中的 LutDumpHeader），供 stitcher_bench 离线读取
+void dump_luts_to_binary(const string &filename, const vector<LutInfo> &luts)
+{
+	ofstream f(filename, ios::binary);
+	if (!f.is_open()) {
+		log_error("Could not open file '%s' for writing.\n", filename.c_str());
+		return;
+	}
+
+	LutDumpHeader header;
+	copy(LUT_DUMP_MAGIC, LUT_DUMP_MAGIC + 4, header.magic);
+	header.version = LUT_DUMP_VERSION;
+	header.num_luts = luts.size();
+	header.num_nets = net_bits.size();
+	f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	for (const auto &lut : luts) {
+		LutRecord record = {};
+		record.init = lut.init;
+		copy(lut.inputs, lut.inputs + 6, record.inputs);
+		record.output = lut.output;
+		record.size = lut.size;
+		f.write(reinterpret_cast<const char *>(&record), sizeof(record));
+	}
+	log("Successfully dumped %zu LUTs (%zu bytes) to '%s'.\n", luts.size(), sizeof(header) + luts.size() * sizeof(LutRecord), filename.c_str());
+}
 #pragma endregion print_funcs
 
-RTLIL::Const calculate_new_init(const LutInfo &lut_a, const LutInfo &lut_b, const vector<SigBit> &new_inputs_vec, const SigBit &sel_bit,
-				SigBit &z_out_sig, SigBit &z5_out_sig)
+// =================================================================
+// 步骤 1: 提取所有GTP_LUT的信息
+// =================================================================
+void CollectLuts(Module *module, SigMap &sigmap, vector<LutInfo> &luts)
 {
-	// --- 准备工作 ---
-	// 辅助函数：检查一个LUT是否包含某个输入信号
-	auto lut_has_input = [](const LutInfo &lut, const SigBit &input_sig) {
-		for (const auto &pair : lut.ordered_inputs) {
-			if (pair.second == input_sig)
-				return true;
-		}
-		return false;
-	};
+	luts.clear();
+	net_bits.clear();
+	net_ids.clear();
+	GetNetId(RTLIL::S0); // CONST0_NET
+	GetNetId(RTLIL::S1); // CONST1_NET
+	for (Cell *cell : module->cells()) {
+		const char *type_str = cell->type.c_str();
+		// GTP_LUT7/8 无法合并进 GTP_LUT6D，也放不进 64 位真值表，直接跳过
+		if (strncmp(type_str, "\\GTP_LUT", 8) == 0 && strlen(type_str) == 9 && type_str[8] >= '1' && type_str[8] <= '6') {
+			LutInfo info;
+			info.cell_ptr = cell;
+			info.size = type_str[8] - '0';
 
-	// 正确的逻辑：不包含sel_bit的LUT用于Z5 (sel=0)，包含sel_bit的用于Z (sel=1)
-	const LutInfo &lut_for_z5 = lut_has_input(lut_a, sel_bit) ? lut_b : lut_a;
-	const LutInfo &lut_for_z_sel1 = lut_has_input(lut_a, sel_bit) ? lut_a : lut_b;
-
-	z5_out_sig = lut_for_z5.output;
-	z_out_sig = lut_for_z_sel1.output;
-
-	vector<SigBit> shared_inputs;
-	for (size_t i = 0; i < 5; ++i)
-		shared_inputs.push_back(new_inputs_vec[i]);
-
-	RTLIL::Const init_a_copy = lut_for_z5.init_val;
-	RTLIL::Const init_b_copy = lut_for_z_sel1.init_val;
-
-	vector<RTLIL::State> z5_bits, z_bits;
-	z5_bits.reserve(32);
-	z_bits.reserve(32);
-
-	// 1. 计算 Z5 (sel=0) 的 32-bit 真值表
-	for (int i = 0; i < 32; ++i) { // 遍历I[4:0]的所有32种组合
-		size_t addr_a = 0;     // 原始lut_for_z5中的地址
-		int bit_pos = 1;       // 对应原始lut_for_z5中输入端口的权重
-
-		// 遍历 lut_for_z5 的每一个原始输入端口
-		for (const auto &pair : lut_for_z5.ordered_inputs) {
-			// 在新LUT的I[4:0]输入中查找这个信号
-			auto it = find(shared_inputs.begin(), shared_inputs.end(), pair.second);
-			if (it != shared_inputs.end()) {
-				int shared_idx = distance(shared_inputs.begin(), it);
-				// 如果在新LUT的当前组合'i'中，这个输入位是'1'
-				if ((i >> shared_idx) & 1)
-					addr_a += bit_pos; // 累加地址
+			// 按照端口名 I0, I1, ... 顺序提取输入，未连接的端口视为常数0
+			for (int i = 0; i < info.size; ++i) {
+				IdString port_id = IdString("\\I" + to_string(i)); // Yosys内部端口名通常带'\'
+				info.inputs[i] = GetNetId(cell->hasPort(port_id) ? sigmap(cell->getPort(port_id)).as_bit() : SigBit(RTLIL::S0));
 			}
-			// 如果找不到，说明这个输入是sel_bit，在I5=0的情况下，它贡献的地址值为0，所以什么都不用做
-			bit_pos <<= 1;
-		}
 
-		if (addr_a < (size_t)GetSize(init_a_copy)) {
-			z5_bits.push_back(init_a_copy.bits().at(addr_a)); // 从原始INIT中查找并存入
-		} else {
-			z5_bits.push_back(RTLIL::S0); // 安全兜底
-		}
-	}
-
-	// 2. 计算 Z (sel=1) 的 32-bit 真值表
-	for (int i = 0; i < 32; ++i) {
-		size_t addr_b = 0;
-		int bit_pos = 1;
-		for (const auto &pair : lut_for_z_sel1.ordered_inputs) {
-			auto it = find(shared_inputs.begin(), shared_inputs.end(), pair.second);
-			if (it != shared_inputs.end()) {
-				int shared_idx = distance(shared_inputs.begin(), it);
-				if ((i >> shared_idx) & 1)
-					addr_b += bit_pos;
-			} else if (pair.second == sel_bit) {
-				// 当计算Z的逻辑时，sel_bit的值被认为是1
-				addr_b += bit_pos;
+			info.output = GetNetId(sigmap(cell->getPort(ID(Z))).as_bit());
+			RTLIL::Const init_val = cell->getParam(ID(INIT));
+			for (int i = 0; i < (1 << info.size) && i < GetSize(init_val); ++i) {
+				if (init_val[i] == RTLIL::S1)
+					info.init |= 1ULL << i;
 			}
-			bit_pos <<= 1;
-		}
-
-		if (addr_b < (size_t)GetSize(init_b_copy)) {
-			z_bits.push_back(init_b_copy.bits().at(addr_b));
-		} else {
-			z_bits.push_back(RTLIL::S0);
+			luts.push_back(info); // 此处自然地为每个LUT标上唯一序号(index)
 		}
 	}
+}
 
-	// --- 写入阶段 ---
-	vector<RTLIL::State> final_init_bits = z5_bits;
-	final_init_bits.insert(final_init_bits.end(), z_bits.begin(), z_bits.end());
+#pragma region stats_funcs
+// =================================================================
+// 统计信息：stitcher -stats <file.json> 时收集，pass 结束后写成一个 JSON 对象，格式如下（schema_version 1）：
+// {
+//   "schema_version": 1,
+//   "module": "top",
+//   "luts": {                      // 步骤 1.5 之后参与搜索的LUT
+//     "total": 1234,
+//     "by_size": {"1": 0, "2": 10, "3": 20, "4": 30, "5": 40, "6": 50},
+//     "by_level": {"0": 100, "1": 80},   // NumberLutsByLevel 计算的深度
+//     "unleveled": 0                  // 没有分到深度的LUT（例如在组合环上）
+//   },
+//   "candidates": {                // 交给规划器的候选对，流式模式下为各批之和
+//     "total": 5000,
+//     "by_type": {"shared_inputs": 4000, "lut6_absorb": 1000},
+//     "by_score": {"10600": 12, "499": 30}  // 分数定义见 check_and_add_candidates 和 AbsorbIndex::find
+//   },
+//   "merges": {
+//     "accepted": 500,
+//     "accepted_by_type": {"shared_inputs": 450, "lut6_absorb": 50},
+//     "rejected": 4500,
+//     "rejected_by_reason": {
+//       "lut_already_merged": 4400,   // 贪心规划时其中一个LUT已被分数更高的候选占用
+//       "duplicate_pair": 60,         // 最大匹配规划时同一对LUT已有分数更高的候选
+//       "not_in_matching": 40         // 最大匹配规划时没有被选入匹配
+//     }
+//   },
+//   "threads": [                   // 每次执行 OpenMP 并行循环的各线程忙碌时间
+//     {"loop": "layered_search", "wall_seconds": 1.5, "busy_seconds": [1.4, 1.3, 1.5, 1.2]},
+//     {"loop": "concat_candidates", ...}, {"loop": "sort_candidates", ...}
+//   ],
+//   "steps": [                     // 按 ScopedTimer 结束的顺序排列
+//     {"name": "Step 1: CollectLuts", "seconds": 0.8, "vm_hwm_kb": 204800, "vm_rss_kb": 198000,
+//      "vm_hwm_delta_kb": 6800, "vm_rss_delta_kb": 5200}
+//   ]
+// }
+// vm_hwm_kb 是步骤结束时进程至今的峰值常驻内存 (/proc/self/status 的 VmHWM)，vm_rss_kb 是当时的常驻内存；
+// *_delta_kb 是结束时减去开始时的读数：vm_hwm_delta_kb 是该步骤把进程峰值抬高了多少（峰值低于此前的
+// 步骤时为 0），vm_rss_delta_kb 是该步骤留下的常驻内存增量，可为负。不重置 VmHWM，yosys 自己的峰值
+// 统计不受影响。读不到时 vm_hwm_kb/vm_rss_kb 为 -1，*_delta_kb 为 null。字段只增不改；改变已有字段的含义时增加 schema_version。
+// =================================================================
+enum class RejectReason : uint8_t { LUT_ALREADY_MERGED, DUPLICATE_PAIR, NOT_IN_MATCHING };
+const int NUM_REJECT_REASONS = 3;
+const char *REJECT_REASON_NAMES[NUM_REJECT_REASONS] = {"lut_already_merged", "duplicate_pair", "not_in_matching"};
+const char *MERGE_TYPE_NAMES[2] = {"shared_inputs", "lut6_absorb"};
 
-	return RTLIL::Const(final_init_bits);
+// 从 /proc/self/status 读取一项内存统计（单位 kB），读不到时返回 -1
+long ReadProcStatusKb(const char *key)
+{
+	ifstream f("/proc/self/status");
+	string line;
+	size_t key_len = strlen(key);
+	while (getline(f, line))
+		if (line.compare(0, key_len, key) == 0 && line.size() > key_len && line[key_len] == ':')
+			return atol(line.c_str() + key_len + 1);
+	return -1;
 }
 
-#pragma region complex_case_funcs
-// 将 Const 转换为 uint64_t 以便进行位运算
-uint64_t const_to_uint64(const RTLIL::Const &c)
-{
-	// 创建一个非const的拷贝，现在可以在它上面安全地调用非const成员函数
-	RTLIL::Const c_copy = c;
+struct StitcherStats : PlanListener {
+	struct StepStats {
+		string name;
+		double seconds;
+		long vm_hwm_kb, vm_rss_kb;
+		long vm_hwm_delta_kb, vm_rss_delta_kb; // 读不到时为 NO_DELTA
+	};
+	static constexpr long NO_DELTA = LONG_MIN;
+	static string delta_json(long delta) { return delta == NO_DELTA ? string("null") : to_string(delta); }
+	struct ThreadStats {
+		string loop;
+		double wall_seconds;
+		vector<double> busy_seconds;
+	};
 
-	uint64_t val = 0;
-	// Yosys 的 Const bit[0] 是最低位
-	for (int i = 0; i < c_copy.size() && i < 64; ++i) {
-		if (c_copy.bits().at(i) == RTLIL::S1) { // 现在调用是合法的
-			val |= (1ULL << i);
+	size_t luts_by_size[7] = {};
+	std::map<int, size_t> luts_by_level;
+	size_t unleveled_luts = 0;
+	size_t candidates_by_type[2] = {};
+	std::map<int, size_t> candidates_by_score;
+	size_t accepted_by_type[2] = {};
+	size_t rejected_by_reason[NUM_REJECT_REASONS] = {};
+	vector<ThreadStats> threads;
+	vector<StepStats> steps;
+
+	// 需要在 NumberLutsByLevel 之后调用
+	void record_luts(const vector<LutInfo> &luts)
+	{
+		for (const auto &lut : luts) {
+			luts_by_size[lut.size]++;
+			auto it = lut_levels.find(lut.cell_ptr);
+			if (it != lut_levels.end())
+				luts_by_level[it->second]++;
+			else
+				unleveled_luts++;
 		}
 	}
-	return val;
-}
 
-// 辅助函数，生成输入信号在64位真值表中的掩码
-uint64_t get_input_mask(const map<string, SigBit> &ordered_inputs_6, const SigBit &target_sig)
-{
-	// 模板掩码
-	const uint64_t masks[] = {
-	  0xAAAAAAAAAAAAAAAA, // I0
-	  0xCCCCCCCCCCCCCCCC, // I1
-	  0xF0F0F0F0F0F0F0F0, // I2
-	  0xFF00FF00FF00FF00, // I3
-	  0xFFFF0000FFFF0000, // I4
-	  0xFFFFFFFF00000000  // I5
-	};
-	int input_idx = 0;
-	for (const auto &pair : ordered_inputs_6) {
-		if (pair.second == target_sig) {
-			return masks[input_idx];
+	void record_candidates(const vector<MergeCandidate> &candidates)
+	{
+		for (const auto &cand : candidates) {
+			candidates_by_type[(int)cand.type]++;
+			candidates_by_score[cand.score]++;
 		}
-		input_idx++;
 	}
-	return 0; // Not found
-}
 
-// 仅考虑了子LUT为5输入时的情况，缺乏INIT扩充代码
-bool CanLut6AbsorbLutS(const LutInfo &lut_6, const LutInfo &lut_s, SigBit &found_sel_bit)
-{
-	// --- 1. 找到潜在的 sel_bit ---
-	// sel_bit 是 lut_6 的输入，但不是 lut_s 的输入
-	vector<SigBit> potential_sel_bits;
-	pool<SigBit> inputs_s;
-	for (const auto &p : lut_s.ordered_inputs)
-		inputs_s.insert(p.second);
-
-	for (const auto &p_6 : lut_6.ordered_inputs) {
-		if (!inputs_s.count(p_6.second)) {
-			potential_sel_bits.push_back(p_6.second);
-		}
-	}
-
-	// 对于 LUT6 吸收 LUTs (s<6)，必须恰好有一个非共享输入作为 sel_bit
-	if (potential_sel_bits.size() != 1) {
-		return false;
-	}
-	found_sel_bit = potential_sel_bits[0];
-
-	// --- 2. 扩展 lut_s 的 INIT 到 64 位 ---
-	// 这个过程是根据输入信号的映射关系来“复制”位
-	uint64_t s_expanded_tt = 0;
-	for (int i = 0; i < (1 << lut_s.size); ++i) {
-		if ((const_to_uint64(lut_s.init_val) >> i) & 1) {
-			// 对于 lut_s 真值表中为'1'的每一行，我们需要在64位空间中找到所有对应的位置并置'1'
-			uint64_t target_mask = 0xFFFFFFFFFFFFFFFF;
-			int s_input_idx = 0;
-			for (const auto &p_s : lut_s.ordered_inputs) {
-				uint64_t lut6_mask = get_input_mask(lut_6.ordered_inputs, p_s.second);
-				if ((i >> s_input_idx) & 1) {
-					target_mask &= lut6_mask; // 该位为1，保留mask
-				} else {
-					target_mask &= ~lut6_mask; // 该位为0，保留mask的反
-				}
-				s_input_idx++;
+	void accept(const MergeCandidate &cand) { accepted_by_type[(int)cand.type]++; }
+	void reject(RejectReason reason, size_t count = 1) { rejected_by_reason[(int)reason] += count; }
+
+	// 贪心规划 (PlanMerges) 的回调
+	void on_candidates(const vector<MergeCandidate> &candidates) override { record_candidates(candidates); }
+	void on_accepted(const MergeCandidate &cand) override { accept(cand); }
+	void on_lut_already_merged(const MergeCandidate &) override { reject(RejectReason::LUT_ALREADY_MERGED); }
+
+	void write_json(const string &filename, Module *module) const
+	{
+		ofstream f(filename);
+		if (!f.is_open()) {
+			log_error("Could not open file '%s' for writing.\n", filename.c_str());
+			return;
+		}
+		auto quoted = [](const string &str) {
+			string out = "\"";
+			for (char c : str) {
+				if (c == '"' || c == '\\')
+					out += '\\';
+				if ((unsigned char)c < 0x20)
+					out += stringf("\\u%04x", c);
+				else
+					out += c;
 			}
-			s_expanded_tt |= target_mask;
+			return out + "\"";
+		};
+		auto histogram = [](const std::map<int, size_t> &counts) {
+			string out;
+			for (const auto &[key, count] : counts)
+				out += stringf("%s\"%d\": %zu", out.empty() ? "" : ", ", key, count);
+			return "{" + out + "}";
+		};
+
+		size_t total_luts = 0, total_candidates = 0, accepted = 0, rejected = 0;
+		for (size_t count : luts_by_size)
+			total_luts += count;
+		for (int t = 0; t < 2; ++t) {
+			total_candidates += candidates_by_type[t];
+			accepted += accepted_by_type[t];
 		}
+		for (size_t count : rejected_by_reason)
+			rejected += count;
+
+		f << "{\n  \"schema_version\": 1,\n  \"module\": " << quoted(log_id(module)) << ",\n";
+		f << "  \"luts\": {\"total\": " << total_luts << ", \"by_size\": {";
+		for (int k = 1; k <= 6; ++k)
+			f << (k > 1 ? ", " : "") << "\"" << k << "\": " << luts_by_size[k];
+		f << "}, \"by_level\": " << histogram(luts_by_level) << ", \"unleveled\": " << unleveled_luts << "},\n";
+		f << "  \"candidates\": {\"total\": " << total_candidates << ", \"by_type\": {";
+		for (int t = 0; t < 2; ++t)
+			f << (t ? ", " : "") << "\"" << MERGE_TYPE_NAMES[t] << "\": " << candidates_by_type[t];
+		f << "}, \"by_score\": " << histogram(candidates_by_score) << "},\n";
+		f << "  \"merges\": {\"accepted\": " << accepted << ", \"accepted_by_type\": {";
+		for (int t = 0; t < 2; ++t)
+			f << (t ? ", " : "") << "\"" << MERGE_TYPE_NAMES[t] << "\": " << accepted_by_type[t];
+		f << "}, \"rejected\": " << rejected << ", \"rejected_by_reason\": {";
+		for (int r = 0; r < NUM_REJECT_REASONS; ++r)
+			f << (r ? ", " : "") << "\"" << REJECT_REASON_NAMES[r] << "\": " << rejected_by_reason[r];
+		f << "}},\n  \"threads\": [";
+		for (size_t i = 0; i < threads.size(); ++i) {
+			f << (i ? "," : "") << "\n    {\"loop\": " << quoted(threads[i].loop) << ", \"wall_seconds\": " << threads[i].wall_seconds
+			  << ", \"busy_seconds\": [";
+			for (size_t t = 0; t < threads[i].busy_seconds.size(); ++t)
+				f << (t ? ", " : "") << threads[i].busy_seconds[t];
+			f << "]}";
+		}
+		f << (threads.empty() ? "" : "\n  ") << "],\n  \"steps\": [";
+		for (size_t i = 0; i < steps.size(); ++i)
+			f << (i ? "," : "") << "\n    {\"name\": " << quoted(steps[i].name) << ", \"seconds\": " << steps[i].seconds
+			  << ", \"vm_hwm_kb\": " << steps[i].vm_hwm_kb << ", \"vm_rss_kb\": " << steps[i].vm_rss_kb
+			  << ", \"vm_hwm_delta_kb\": " << delta_json(steps[i].vm_hwm_delta_kb)
+			  << ", \"vm_rss_delta_kb\": " << delta_json(steps[i].vm_rss_delta_kb) << "}";
+		f << (steps.empty() ? "" : "\n  ") << "]\n}\n";
+		log("Successfully wrote stitcher statistics to '%s'.\n", filename.c_str());
 	}
+};
 
-	// --- 3. 模板匹配验证 ---
-	uint64_t sel_mask = get_input_mask(lut_6.ordered_inputs, found_sel_bit);
-	uint64_t tt_6 = const_to_uint64(lut_6.init_val);
+// 只在 -stats 开启时非空
+StitcherStats *stitcher_stats = nullptr;
 
-	// 检查当 sel=0 时，lut_6 的逻辑是否与扩展后的 lut_s 逻辑相同
-	// 我们只关心 sel_mask 中为'0'的那些位
-	bool sel_is_0_match = ((tt_6 & ~sel_mask) == (s_expanded_tt & ~sel_mask));
+void ReadStepMemory(long &vm_hwm_kb, long &vm_rss_kb)
+{
+	if (!stitcher_stats)
+		return;
+	vm_hwm_kb = ReadProcStatusKb("VmHWM");
+	vm_rss_kb = ReadProcStatusKb("VmRSS");
+}
 
-	// 检查当 sel=1 时，lut_6 的逻辑是否与扩展后的 lut_s 逻辑相同
-	// 我们只关心 sel_mask 中为'1'的那些位
-	bool sel_is_1_match = ((tt_6 & sel_mask) == (s_expanded_tt & sel_mask));
+void RecordStepStats(const std::string &task_name, double seconds, long start_hwm_kb, long start_rss_kb)
+{
+	if (!stitcher_stats)
+		return;
+	long hwm_kb = -1, rss_kb = -1;
+	ReadStepMemory(hwm_kb, rss_kb);
+	// 计时器在 -stats 开启前创建时没有开始读数
+	long hwm_delta = hwm_kb < 0 || start_hwm_kb < 0 ? StitcherStats::NO_DELTA : hwm_kb - start_hwm_kb;
+	long rss_delta = rss_kb < 0 || start_rss_kb < 0 ? StitcherStats::NO_DELTA : rss_kb - start_rss_kb;
+	stitcher_stats->steps.push_back({task_name, seconds, hwm_kb, rss_kb, hwm_delta, rss_delta});
+}
+#pragma endregion stats_funcs
 
-	// 只要其中一种情况匹配，就可以合并
-	// 如果 sel=0 匹配，那么 lut_s 的逻辑可以放在 Z5 端口
-	// 如果 sel=1 匹配，那么 lut_s 的逻辑可以放在 Z 端口
-	return sel_is_0_match || sel_is_1_match;
+// 只保留 lut 的 keep[0..keep_size) 这几个输入，tt64 必须不依赖其余输入；同步修改记录和网表中的cell
+void KeepLutInputs(LutInfo &lut, uint64_t tt64, const int keep[6], int keep_size)
+{
+	uint32_t new_inputs[6] = {};
+	uint64_t new_init = 0;
+	for (int idx = 0; idx < keep_size; ++idx)
+		new_inputs[idx] = lut.inputs[keep[idx]];
+	for (int m = 0; m < (1 << keep_size); ++m) {
+		int addr = 0;
+		for (int idx = 0; idx < keep_size; ++idx)
+			if ((m >> idx) & 1)
+				addr |= 1 << keep[idx];
+		new_init |= ((tt64 >> addr) & 1) << m;
+	}
+
+	Cell *cell = lut.cell_ptr;
+	cell->type = IdString("\\GTP_LUT" + to_string(keep_size));
+	for (int k = 0; k < lut.size; ++k) {
+		IdString port_id = IdString("\\I" + to_string(k));
+		if (k < keep_size)
+			cell->setPort(port_id, net_bits[new_inputs[k]]);
+		else
+			cell->unsetPort(port_id);
+	}
+	cell->setParam(ID(INIT), init_to_const(new_init, 1 << keep_size));
+
+	lut.size = keep_size;
+	copy(new_inputs, new_inputs + 6, lut.inputs);
+	lut.init = new_init;
 }
-#pragma endregion complex_case_funcs
 
 // =================================================================
-// 步骤 1: 提取所有GTP_LUT的信息
+// 步骤 1.5: 常数输入折叠。接到 1'b0/1'b1 的输入把真值表固定到对应的余因子后删去（与 score.cc 的
+// RemoveConstInput 一致，x/z 按 0 处理），它们不再占用并集的 5 个名额，也不再计入引脚。
+// active 非空时（增量模式）只处理改动过的LUT，其余LUT在上一次 stitcher 时已经处理过。
 // =================================================================
-void CollectLuts(Module *module, SigMap &sigmap, vector<LutInfo> &luts)
+void FoldConstantInputs(vector<LutInfo> &luts, const vector<char> *active = nullptr)
 {
-	luts.clear();
-	for (Cell *cell : module->cells()) {
-		const char *type_str = cell->type.c_str();
-		if (strncmp(type_str, "\\GTP_LUT", 8) == 0 && strlen(type_str) == 9) {
-			LutInfo info;
-			info.cell_ptr = cell;
-			info.size = type_str[8] - '0';
-
-			// 按照端口名 I0, I1, ... 顺序提取输入
-			for (int i = 0; i < info.size; ++i) {
-				string port_name = "I" + to_string(i);
-				IdString port_id = IdString("\\" + port_name); // Yosys内部端口名通常带'\'
-
-				if (cell->hasPort(port_id)) {
-					// 将 (端口名, 信号) 存入有序字典
-					info.ordered_inputs[port_name] = sigmap(cell->getPort(port_id));
-				}
+	size_t folded_luts = 0;
+	size_t removed_pins = 0;
+	for (size_t i = 0; i < luts.size(); ++i) {
+		if (active && !(*active)[i])
+			continue;
+		LutInfo &lut = luts[i];
+		uint64_t tt64 = expand_truth_table(lut.init, lut.size);
+		int keep[6];
+		int keep_size = 0;
+		for (int k = 0; k < lut.size; ++k) {
+			const SigBit &bit = net_bits[lut.inputs[k]];
+			if (bit.wire) {
+				keep[keep_size++] = k;
+				continue;
 			}
-
-			info.output = sigmap(cell->getPort(ID(Z)));
-			info.init_val = cell->getParam(ID(INIT));
-			luts.push_back(info); // 此处自然地为每个LUT标上唯一序号(index)
+			uint64_t half = bit.data == RTLIL::S1 ? (tt64 & INPUT_MASKS[k]) >> (1 << k) : tt64 & ~INPUT_MASKS[k];
+			tt64 = half | (half << (1 << k));
 		}
+		// 全部输入都是常数时保留一个输入，GTP_LUT 至少要有一个输入
+		if (keep_size == lut.size || keep_size == 0)
+			continue;
+		removed_pins += lut.size - keep_size;
+		folded_luts++;
+		KeepLutInputs(lut, tt64, keep, keep_size);
+		lut.is_shrunk = true;
 	}
+	log("Folded constant inputs of %zu LUTs, %zu pins removed.\n", folded_luts, removed_pins);
 }
 
 // =================================================================
-// 步骤 2: 寻找并评估所有可合并的候选对
+// 步骤 1.5: 去掉LUT中与真值表无关的输入（即正负余因子相同的输入），缩小LUT尺寸和INIT。
+// 这些假输入会让 check_and_add_candidates 中的并集超过5而错过合并，也会多算引脚。
+// active 的含义同 FoldConstantInputs。
 // =================================================================
-enum class MergeType {
-	SHARED_INPUTS, // 总输入<=5
-	LUT6_ABSORB    // LUT6吸收小LUT
-};
-
-struct MergeCandidate {
-	int idx_a, idx_b;
-	int score;
-	pool<SigBit> union_inputs;
-
-	MergeType type;
-	SigBit discovered_sel_bit; // 仅在 LUT6_ABSORB 类型下有效
+void ShrinkLutSupport(vector<LutInfo> &luts, const vector<char> *active = nullptr)
+{
+	size_t shrunk_luts = 0;
+	size_t saved_pins = 0;
+	for (size_t i = 0; i < luts.size(); ++i) {
+		if (active && !(*active)[i])
+			continue;
+		LutInfo &lut = luts[i];
+		uint64_t tt64 = expand_truth_table(lut.init, lut.size);
+		int support[6];
+		int support_size = 0;
+		for (int k = 0; k < lut.size; ++k)
+			if (depends_on_input(tt64, k))
+				support[support_size++] = k;
+		// 常数LUT至少保留一个输入
+		if (support_size == lut.size || support_size == 0)
+			continue;
+		saved_pins += lut.size - support_size;
+		shrunk_luts++;
+		KeepLutInputs(lut, tt64, support, support_size);
+		lut.is_shrunk = true;
+	}
+	log("Shrunk %zu LUTs with redundant inputs, %zu pins saved.\n", shrunk_luts, saved_pins);
+}
 
-	bool operator<(const MergeCandidate &other) const { return score < other.score; }
+// 步骤 1.5 之前的输入，用于统计只有折叠/去除无关输入后才成立的合并
+struct PreShrinkInputs {
+	int size;
+	uint32_t inputs[6];
 };
 
+// 统计按步骤 1.5 之前的输入并集超出合并上限的合并数：共享输入合并的上限是 5，
+// LUT6 吸收的上限是 LUT6 本身的 6 个输入，即 max(5, 当前并集大小)
+size_t CountShrinkEnabledMerges(const vector<LutInfo> &luts, const vector<PreShrinkInputs> &pre_shrink, const vector<MergePlan> &plans)
+{
+	dict<Cell *, int> merged_idx;
+	for (size_t i = 0; i < luts.size(); ++i)
+		if (luts[i].is_merged)
+			merged_idx[luts[i].cell_ptr] = i;
+	size_t enabled = 0;
+	for (const auto &plan : plans) {
+		int idx_a = merged_idx.at(plan.cell_a), idx_b = merged_idx.at(plan.cell_b);
+		if (!luts[idx_a].is_shrunk && !luts[idx_b].is_shrunk)
+			continue;
+		LutInfo orig_a, orig_b;
+		orig_a.size = pre_shrink[idx_a].size;
+		orig_b.size = pre_shrink[idx_b].size;
+		copy(pre_shrink[idx_a].inputs, pre_shrink[idx_a].inputs + 6, orig_a.inputs);
+		copy(pre_shrink[idx_b].inputs, pre_shrink[idx_b].inputs + 6, orig_b.inputs);
+		uint32_t union_inputs[12];
+		int union_size = get_union_inputs(luts[idx_a], luts[idx_b], union_inputs);
+		if (get_union_inputs(orig_a, orig_b, union_inputs) > max(5, union_size))
+			enabled++;
+	}
+	return enabled;
+}
+
 // =================================================================
-// 新的、独立的辅助函数，用于检查一对LUT的所有合并可能性
+// 步骤 2: 寻找并评估所有可合并的候选对（候选对、余因子索引和共享输入索引见 stitcher_core.h）
 // =================================================================
-void check_and_add_candidates(const vector<LutInfo> &luts, int idx_a, int idx_b, vector<MergeCandidate> &local_candidates)
+// 把各线程的候选缓冲区拼接成一个连续数组：先用前缀和算出每个缓冲区的偏移，再并行拷贝，不需要加锁
+void ConcatCandidates(vector<vector<MergeCandidate>> &thread_buffers, vector<MergeCandidate> &candidates)
 {
-	const LutInfo &lut_a = luts[idx_a];
-	const LutInfo &lut_b = luts[idx_b];
-
-	// --- 逻辑 1: 检查 SHARED_INPUTS 类型的合并 (来自旧的 check_shared_inputs) ---
-	pool<SigBit> current_union_inputs;
-	for (const auto &pair : lut_a.ordered_inputs)
-		current_union_inputs.insert(pair.second);
-	for (const auto &pair : lut_b.ordered_inputs)
-		current_union_inputs.insert(pair.second);
-
-	if (current_union_inputs.size() <= 5) {
-		int shared_inputs = (lut_a.size + lut_b.size) - current_union_inputs.size();
-		if (shared_inputs >= 1) {
-			int score = shared_inputs * 100 - current_union_inputs.size();
-			local_candidates.push_back({idx_a, idx_b, score, current_union_inputs, MergeType::SHARED_INPUTS, RTLIL::Sx});
-		}
-	}
-
-	// // --- 逻辑 2: 检查 LUT6_ABSORB 类型的合并 (来自旧的 check_lut6_absorb) ---
-
-	// // 可能性 A: a 吸收 b
-	// if (lut_a.size == 6 && lut_b.size < 6) {
-	//     pool<SigBit> inputs_a;
-	// 	for (const auto &p : lut_a.ordered_inputs) inputs_a.insert(p.second);
-
-	//     // 检查输入子集关系
-	//     bool is_subset = true;
-	//     for (const auto &p_b : lut_b.ordered_inputs) {
-	//         if (!inputs_a.count(p_b.second)) {
-	//             is_subset = false;
-	//             break;
-	//         }
-	//     }
-
-	//     if (is_subset) {
-	//         SigBit sel_bit;
-	//         if (CanLut6AbsorbLutS(lut_a, lut_b, sel_bit)) {
-	//             int score = 10000 + lut_b.size * 100;
-	//             local_candidates.push_back({idx_a, idx_b, score, inputs_a, MergeType::LUT6_ABSORB, sel_bit});
-	//         }
-	//     }
-	// }
-
-	// // 可能性 B: b 吸收 a
-	// if (lut_b.size == 6 && lut_a.size < 6) {
-	//     pool<SigBit> inputs_b;
-	// 	for (const auto &p : lut_b.ordered_inputs) inputs_b.insert(p.second);
-
-	//     // 检查输入子集关系
-	//     bool is_subset = true;
-	//     for (const auto &p_a : lut_a.ordered_inputs) {
-	//         if (!inputs_b.count(p_a.second)) {
-	//             is_subset = false;
-	//             break;
-	//         }
-	//     }
-
-	//     if (is_subset) {
-	//         SigBit sel_bit;
-	//         if (CanLut6AbsorbLutS(lut_b, lut_a, sel_bit)) {
-	//             int score = 10000 + lut_a.size * 100;
-	//             local_candidates.push_back({idx_b, idx_a, score, inputs_b, MergeType::LUT6_ABSORB, sel_bit});
-	//         }
-	//     }
-	// }
+	auto start_time = std::chrono::high_resolution_clock::now();
+	vector<size_t> offsets(thread_buffers.size() + 1, candidates.size());
+	for (size_t t = 0; t < thread_buffers.size(); ++t)
+		offsets[t + 1] = offsets[t] + thread_buffers[t].size();
+	candidates.resize(offsets.back());
+#ifdef USE_OPENMP
+	vector<double> thread_busy(omp_get_max_threads(), 0.0);
+#pragma omp parallel for schedule(static, 1)
+#else
+	vector<double> thread_busy(1, 0.0);
+#endif
+	for (size_t t = 0; t < thread_buffers.size(); ++t) {
+		auto busy_start = std::chrono::high_resolution_clock::now();
+		copy(thread_buffers[t].begin(), thread_buffers[t].end(), candidates.begin() + offsets[t]);
+		vector<MergeCandidate>().swap(thread_buffers[t]);
+#ifdef USE_OPENMP
+		int thread_id = omp_get_thread_num();
+#else
+		int thread_id = 0;
+#endif
+		thread_busy[thread_id] += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - busy_start).count();
+	}
+	if (stitcher_stats) {
+		double wall_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+		stitcher_stats->threads.push_back({"concat_candidates", wall_seconds, thread_busy});
+	}
 }
 
 // 已添加多线程并行功能
-void FindMergeCandidates_Layered(const vector<LutInfo> &luts, priority_queue<MergeCandidate> &candidates)
+void FindMergeCandidates_Layered(const vector<LutInfo> &luts, vector<MergeCandidate> &candidates)
 {
 #ifdef USE_OPENMP
 	log("Using layered search strategy (LUT count > %zu) with multi-threading.\n", LAYERED_SEARCH_THRESHOLD);
+	int num_threads = omp_get_max_threads();
 #else
 	log("Using layered search strategy (LUT count > %zu) without multi-threading.\n", LAYERED_SEARCH_THRESHOLD);
+	int num_threads = 1;
 #endif
 
 	auto start_time = std::chrono::high_resolution_clock::now();
@@ -571,6 +714,11 @@ void FindMergeCandidates_Layered(const vector<LutInfo> &luts, priority_queue<Mer
 		max_level = level_to_lut_indices.rbegin()->first;
 	}
 
+	// 每个线程只往自己的缓冲区里写，所有层搜索完后再统一拼接
+	vector<vector<MergeCandidate>> thread_buffers(num_threads);
+	// 各线程在并行区域内的忙碌时间（不含等待其他线程的时间），用于 -stats
+	vector<double> thread_busy(num_threads, 0.0);
+
 	// 串行地遍历每一个 level
 	for (int level = 0; level <= max_level; ++level) {
 		if (timed_out)
@@ -579,68 +727,43 @@ void FindMergeCandidates_Layered(const vector<LutInfo> &luts, priority_queue<Mer
 			continue;
 
 		const vector<int> &luts_in_current_level = level_to_lut_indices.at(level);
-
-		// --- 1. 并行化层内搜索 ---
-		// 使用一个临时的 vector 来收集所有线程的局部结果
-		vector<vector<MergeCandidate>> thread_local_results;
+		const vector<int> *luts_in_next_level = level_to_lut_indices.count(level + 1) ? &level_to_lut_indices.at(level + 1) : nullptr;
 
 #ifdef USE_OPENMP
 #pragma omp parallel
 #endif
 		{
-			// 【正确】在并行区域内声明私有变量
-			vector<MergeCandidate> local_candidates;
+#ifdef USE_OPENMP
+			int thread_id = omp_get_thread_num();
+#else
+			int thread_id = 0;
+#endif
+			vector<MergeCandidate> &local_candidates = thread_buffers[thread_id];
+			auto busy_start = std::chrono::high_resolution_clock::now();
 
-// 【正确】让 OpenMP 自动将 i 的循环分配给各个线程
+			// --- 1. 并行化层内搜索 ---
 #ifdef USE_OPENMP
 #pragma omp for schedule(dynamic) nowait
 #endif
 			for (size_t i = 0; i < luts_in_current_level.size(); ++i) {
 				for (size_t j = i + 1; j < luts_in_current_level.size(); ++j) {
-					// 调用 Lambda 时，直接传递局部容器
 					check_and_add_candidates(luts, luts_in_current_level[i], luts_in_current_level[j], local_candidates);
 				}
 			}
 
-			// 【正确】每个线程在完成自己的任务后，将自己的私有结果安全地汇总
+			// --- 2. 并行化层间搜索 ---
+			if (luts_in_next_level) {
 #ifdef USE_OPENMP
-#pragma omp critical
-#endif
-			{
-				thread_local_results.push_back(std::move(local_candidates));
-			}
-		} // --- 并行区域结束 ---
-
-		// --- 2. 并行化层间搜索 ---
-		if (level_to_lut_indices.count(level + 1)) {
-			const vector<int> &luts_in_next_level = level_to_lut_indices.at(level + 1);
-#ifdef USE_OPENMP
-#pragma omp parallel
-#endif
-			{
-				vector<MergeCandidate> local_candidates;
 #pragma omp for schedule(dynamic) nowait
+#endif
 				for (size_t i = 0; i < luts_in_current_level.size(); ++i) {
-					for (size_t j = 0; j < luts_in_next_level.size(); ++j) {
-						// 【修改】直接调用新的辅助函数
-						check_and_add_candidates(luts, luts_in_current_level[i], luts_in_next_level[j], local_candidates);
+					for (size_t j = 0; j < luts_in_next_level->size(); ++j) {
+						check_and_add_candidates(luts, luts_in_current_level[i], (*luts_in_next_level)[j], local_candidates);
 					}
 				}
-#ifdef USE_OPENMP
-#pragma omp critical
-#endif
-				{
-					thread_local_results.push_back(std::move(local_candidates));
-				}
-			} // --- 并行区域结束 ---
-		}
-
-		// --- 3. 串行地将所有结果合并到全局优先队列 ---
-		for (const auto &vec : thread_local_results) {
-			for (const auto &cand : vec) {
-				candidates.push(cand);
 			}
-		}
+			thread_busy[thread_id] += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - busy_start).count();
+		} // --- 并行区域结束 ---
 
 		// 串行地进行超时检查
 		auto current_time = std::chrono::high_resolution_clock::now();
@@ -650,174 +773,480 @@ void FindMergeCandidates_Layered(const vector<LutInfo> &luts, priority_queue<Mer
 		}
 	}
 
+	if (stitcher_stats) {
+		double wall_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+		stitcher_stats->threads.push_back({"layered_search", wall_seconds, thread_busy});
+	}
+
+	// --- 3. 拼接所有线程的结果 ---
+	ConcatCandidates(thread_buffers, candidates);
+
 	if (timed_out) {
 		log_warning("Search in FindMergeCandidates_Layered timed out after %.1f seconds.\n", SEARCH_TIMEOUT_SECONDS);
 	}
 }
 
-void FindMergeCandidates_Global(const vector<LutInfo> &luts, priority_queue<MergeCandidate> &candidates)
+// 增量模式：只在 active（改动过或刚拆开的）LUT 附近寻找候选对
+void FindMergeCandidates_Incremental(const vector<LutInfo> &luts, const vector<char> &active, vector<MergeCandidate> &candidates)
+{
+	size_t num_active = count(active.begin(), active.end(), 1);
+	log("Using incremental search strategy around %zu changed LUTs.\n", num_active);
+
+	SharedNetIndex index(luts, net_bits.size());
+	size_t visited_pairs = index.for_each_pair_around(active, [&](int i, int j) { check_and_add_candidates(luts, i, j, candidates); });
+
+	log("Visited %zu LUT pairs around the changed LUTs.\n", visited_pairs);
+}
+
+// 用 AbsorbIndex 找出所有 LUT6 吸收小 LUT 的候选，给定 active 时只保留涉及 active LUT 的候选
+void FindAbsorbCandidates(const vector<LutInfo> &luts, vector<MergeCandidate> &candidates, const vector<char> *active = nullptr)
+{
+	AbsorbIndex index(luts);
+	size_t before = candidates.size();
+	for (size_t i = 0; i < luts.size(); ++i)
+		index.find(luts, i, [&](const MergeCandidate &cand) {
+			if (!active || (*active)[cand.idx_a] || (*active)[cand.idx_b])
+				candidates.push_back(cand);
+		});
+	log("Indexed %zu LUT6 cofactors, found %zu LUT6 absorb candidates.\n", index.cofactors.size(), candidates.size() - before);
+}
+
+void FindMergeCandidates_Global(const vector<LutInfo> &luts, vector<MergeCandidate> &candidates)
 {
 	log("Using global search strategy (LUT count <= %zu).\n", LAYERED_SEARCH_THRESHOLD);
 
-	//  --- 第一部分：处理总输入 <= 5 的情况 (代码保持不变) ---
-	for (size_t i = 0; i < luts.size(); ++i) {
-		for (size_t j = i + 1; j < luts.size(); ++j) {
-			const LutInfo &lut_a = luts[i];
-			const LutInfo &lut_b = luts[j];
-
-			// 合并检查
-			pool<SigBit> current_union_inputs;
-			for (const auto &pair : lut_a.ordered_inputs)
-				current_union_inputs.insert(pair.second);
-			for (const auto &pair : lut_b.ordered_inputs)
-				current_union_inputs.insert(pair.second);
-
-			int shared_inputs = (lut_a.size + lut_b.size) - current_union_inputs.size();
-
-			if (current_union_inputs.size() <= 5 && shared_inputs >= 1) {
-				// 计算分数：共享输入数 * 100 - 总输入数
-				int shared_inputs = (lut_a.size + lut_b.size) - current_union_inputs.size();
-				int score = shared_inputs * 100 - current_union_inputs.size();
-				candidates.push({(int)i, (int)j, score, current_union_inputs, MergeType::SHARED_INPUTS, RTLIL::Sx});
+	SharedNetIndex index(luts, net_bits.size());
+	size_t visited_pairs = index.for_each_pair([&](int i, int j) { check_and_add_candidates(luts, i, j, candidates); });
+
+	log("Visited %zu LUT pairs through %zu input nets (%zu high-fanout nets capped at %zu pairs per reader).\n", visited_pairs,
+	    index.used_nets, index.capped_nets, MAX_NET_FANOUT_PAIRS);
+}
+
+// =================================================================
+// 最大匹配规划：贪心规划每次取分数最高的候选对，可能比最优方案少合并不少LUT。
+// 这里把LUT看作顶点、候选对看作边，在贪心结果的基础上用带花树 (Edmonds blossom) 算法
+// 寻找增广路，得到最大基数匹配。每次合并都减少一个LUT，所以匹配数就是合并数。
+// =================================================================
+struct BlossomMatcher {
+	const vector<vector<int>> &adj;
+	vector<int> match, parent, base;
+	vector<char> used, blossom, dead;
+	vector<int> lca_mark;
+	int lca_stamp = 0;
+	vector<int> tree; // 当前搜索树中的顶点，只重置这些顶点的状态
+
+	BlossomMatcher(const vector<vector<int>> &adj, const vector<int> &seed)
+	    : adj(adj), match(seed), parent(adj.size(), -1), base(adj.size()), used(adj.size(), 0), blossom(adj.size(), 0), dead(adj.size(), 0),
+	      lca_mark(adj.size(), 0)
+	{
+		for (size_t i = 0; i < adj.size(); ++i)
+			base[i] = i;
+	}
+
+	int lca(int a, int b)
+	{
+		lca_stamp++;
+		while (true) {
+			a = base[a];
+			lca_mark[a] = lca_stamp;
+			if (match[a] == -1)
+				break;
+			a = parent[match[a]];
+		}
+		while (true) {
+			b = base[b];
+			if (lca_mark[b] == lca_stamp)
+				return b;
+			b = parent[match[b]];
+		}
+	}
+
+	void mark_path(int v, int b, int children)
+	{
+		while (base[v] != b) {
+			blossom[base[v]] = blossom[base[match[v]]] = 1;
+			parent[v] = children;
+			children = match[v];
+			v = parent[match[v]];
+		}
+	}
+
+	// 从 root 出发的 BFS，返回增广路的另一端点，找不到时返回 -1
+	int find_path(int root)
+	{
+		for (int v : tree) {
+			used[v] = 0;
+			parent[v] = -1;
+			base[v] = v;
+		}
+		tree.clear();
+		used[root] = 1;
+		tree.push_back(root);
+		queue<int> q;
+		q.push(root);
+		while (!q.empty()) {
+			int v = q.front();
+			q.pop();
+			for (int to : adj[v]) {
+				if (dead[to] || base[v] == base[to] || match[v] == to)
+					continue;
+				if (to == root || (match[to] != -1 && parent[match[to]] != -1)) {
+					// 发现奇环，收缩成花
+					int cur_base = lca(v, to);
+					mark_path(v, cur_base, to);
+					mark_path(to, cur_base, v);
+					size_t tree_size = tree.size();
+					for (size_t k = 0; k < tree_size; ++k) {
+						int i = tree[k];
+						if (blossom[base[i]]) {
+							base[i] = cur_base;
+							if (!used[i]) {
+								used[i] = 1;
+								q.push(i);
+							}
+						}
+					}
+					for (int i : tree)
+						blossom[i] = 0;
+				} else if (parent[to] == -1) {
+					parent[to] = v;
+					tree.push_back(to);
+					if (match[to] == -1)
+						return to;
+					int mate = match[to];
+					used[mate] = 1;
+					tree.push_back(mate);
+					q.push(mate);
+				}
 			}
 		}
+		return -1;
 	}
-	// //	--- 第二部分：处理 LUT6 吸收小 LUT 的情况 ---
-	// for (size_t i = 0; i < luts.size(); ++i) {
-	// 	if (luts[i].size != 6)
-	// 		continue; // 只从 LUT6 开始
-	// 	const LutInfo &lut_6 = luts[i];
-
-	// 	for (size_t j = 0; j < luts.size(); ++j) {
-	// 		if (i == j)
-	// 			continue;
-	// 		const LutInfo &lut_s = luts[j];
-
-	// 		// 1. 检查输入子集关系
-	// 		pool<SigBit> inputs_6, inputs_s;
-	// 		for (const auto &p : lut_6.ordered_inputs)
-	// 			inputs_6.insert(p.second);
-	// 		for (const auto &p : lut_s.ordered_inputs)
-	// 			inputs_s.insert(p.second);
-
-	// 		bool is_subset = true;
-	// 		for (const auto &sig_s : inputs_s) {
-	// 			if (!inputs_6.count(sig_s)) {
-	// 				is_subset = false;
-	// 				break;
-	// 			}
-	// 		}
-	// 		if (!is_subset)
-	// 			continue;
-
-	// 		// 2. 检查逻辑关系 (调用新的辅助函数)
-	// 		SigBit sel_bit;
-	// 		if (CanLut6AbsorbLutS(lut_6, lut_s, sel_bit)) {
-	// 			// 这是一个完美的吸收机会！
-	// 			// 给予极高的分数，确保优先处理
-	// 			int score = 10000 + lut_s.size * 100;
-	// 			candidates.push({(int)i, (int)j, score, inputs_6, MergeType::LUT6_ABSORB, sel_bit});
-	// 		}
-	// 	}
-	// }
+
+	// 对每个未匹配顶点寻找增广路。搜索失败时整棵搜索树 (Hungarian tree) 以后都不会再出现在增广路上，
+	// 直接标记删除，因此总代价接近线性
+	int augment_all()
+	{
+		int augmented = 0;
+		for (size_t root = 0; root < adj.size(); ++root) {
+			if (match[root] != -1 || dead[root] || adj[root].empty())
+				continue;
+			int v = find_path(root);
+			if (v == -1) {
+				for (int i : tree)
+					dead[i] = 1;
+				continue;
+			}
+			while (v != -1) {
+				int pv = parent[v];
+				int ppv = match[pv];
+				match[v] = pv;
+				match[pv] = v;
+				v = ppv;
+			}
+			augmented++;
+		}
+		return augmented;
+	}
+};
+
+vector<MergePlan> PlanMerges_Matching(vector<LutInfo> &luts, const vector<MergeCandidate> &edges)
+{
+	// edges 已按分数从高到低排好序，同一对LUT只保留分数最高的候选
+	vector<vector<int>> adj(luts.size());
+	dict<pair<int, int>, int> best_edge;
+	for (size_t k = 0; k < edges.size(); ++k) {
+		int a = edges[k].idx_a, b = edges[k].idx_b;
+		auto key = make_pair(min(a, b), max(a, b));
+		if (best_edge.count(key))
+			continue;
+		best_edge[key] = k;
+		adj[a].push_back(b);
+		adj[b].push_back(a);
+	}
+
+	// 贪心结果作为初始匹配
+	vector<int> seed(luts.size(), -1);
+	size_t greedy_merges = 0;
+	for (const auto &edge : edges) {
+		if (seed[edge.idx_a] == -1 && seed[edge.idx_b] == -1) {
+			seed[edge.idx_a] = edge.idx_b;
+			seed[edge.idx_b] = edge.idx_a;
+			greedy_merges++;
+		}
+	}
+
+	BlossomMatcher matcher(adj, seed);
+	int augmented = matcher.augment_all();
+	if (stitcher_stats)
+		stitcher_stats->record_candidates(edges);
+
+	vector<MergePlan> plans;
+	for (size_t v = 0; v < luts.size(); ++v) {
+		int u = matcher.match[v];
+		if (u == -1 || u < (int)v)
+			continue;
+		const MergeCandidate &best_pair = edges[best_edge.at(make_pair((int)v, u))];
+		luts[v].is_merged = true;
+		luts[u].is_merged = true;
+		plans.push_back(BuildMergePlan(luts, best_pair));
+		if (stitcher_stats)
+			stitcher_stats->accept(best_pair);
+	}
+	if (stitcher_stats) {
+		stitcher_stats->reject(RejectReason::DUPLICATE_PAIR, edges.size() - best_edge.size());
+		stitcher_stats->reject(RejectReason::NOT_IN_MATCHING, best_edge.size() - plans.size());
+	}
+	log("Greedy planner: %zu merges, matching planner: %zu merges (%d augmenting paths).\n", greedy_merges, plans.size(), augmented);
+	return plans;
 }
 
 // =================================================================
-// 步骤 3: 执行合并操作
-// 用于存储合并计划的安全结构体，不包含任何实时指针
+// 流式模式：候选对按分数档位分桶，按档位从高到低提交成合并计划，已合并的LUT在后续生成中直接跳过。
+// 档位 0 为 LUT6 吸收，档位 1..5 为共享 5..1 个输入，内存中最多同时保存 max_candidates 个候选。
+// 档位 1..5 在同一次 for_each_pair 遍历中分桶收集；超出上限时先放弃最低的档位，留到下一次遍历
+// 再生成（那时更多LUT已合并，候选更少），这样每个档位仍在所有更高档位提交之后才提交。
 // =================================================================
-struct MergePlan {
-	RTLIL::IdString new_cell_name;			      // 生成新LUT的名字
-	RTLIL::Const init_val;				      // 生成新LUT的真值表
-	map<RTLIL::IdString, RTLIL::SigBit> port_connections; // 生成新LUT的信号
-	RTLIL::IdString cell_a_to_remove;		      // 只存储名字
-	RTLIL::IdString cell_b_to_remove;		      // 只存储名字
-};
+const int NUM_CANDIDATE_TIERS = 6;
 
-// 此函数只负责规划，返回一个安全的计划列表
-vector<MergePlan> PlanMerges(Module *module, vector<LutInfo> &luts, priority_queue<MergeCandidate> &candidates)
+int candidate_tier(const MergeCandidate &cand)
 {
-	vector<MergePlan> plans;
+	if (cand.type == MergeType::LUT6_ABSORB)
+		return 0;
+	// score = shared * 100 - union，union 在 1..5 之间
+	int shared_inputs = cand.score / 100 + 1;
+	return 6 - shared_inputs;
+}
 
-	while (!candidates.empty()) {
-		MergeCandidate best_pair = candidates.top();
-		candidates.pop();
+vector<MergePlan> StreamMerges(vector<LutInfo> &luts, size_t max_candidates)
+{
+	log("Using streaming search strategy, at most %zu candidates in memory.\n", max_candidates);
+	SharedNetIndex index(luts, net_bits.size());
 
-		LutInfo &lut_a = luts[best_pair.idx_a];
-		LutInfo &lut_b = luts[best_pair.idx_b];
+	vector<MergePlan> plans;
+	vector<vector<MergeCandidate>> buckets(NUM_CANDIDATE_TIERS);
+	vector<size_t> generated(NUM_CANDIDATE_TIERS, 0);
+	vector<size_t> committed(NUM_CANDIDATE_TIERS, 0);
+	vector<MergeCandidate> pair_candidates;
+	size_t buffered = 0;
+	size_t peak_candidates = 0;
+	size_t num_batches = 0;
+	size_t num_sweeps = 0;
+	auto commit = [&](int tier) {
+		vector<MergeCandidate> &bucket = buckets[tier];
+		if (bucket.empty())
+			return;
+		SortCandidates(bucket);
+		vector<MergePlan> batch_plans = PlanMerges(luts, bucket, stitcher_stats);
+		plans.insert(plans.end(), batch_plans.begin(), batch_plans.end());
+		committed[tier] += batch_plans.size();
+		buffered -= bucket.size();
+		num_batches++;
+		vector<MergeCandidate>().swap(bucket);
+	};
+	auto log_tier = [&](int tier) {
+		string tier_name = tier == 0 ? string("LUT6 absorb") : stringf("%d shared inputs", 6 - tier);
+		log("Tier %d (%s): %zu candidates, %zu merges committed.\n", tier, tier_name.c_str(), generated[tier], committed[tier]);
+	};
 
-		if (lut_a.is_merged || lut_b.is_merged)
-			continue;
+	// 档位 0：LUT6 吸收，单独用余因子索引生成。同一档位内超出上限时只能提前提交一批
+	{
+		AbsorbIndex absorb_index(luts);
+		for (size_t i = 0; i < luts.size(); ++i) {
+			if (luts[i].is_merged)
+				continue;
+			absorb_index.find(luts, i, [&](const MergeCandidate &cand) {
+				if (luts[cand.idx_a].is_merged || luts[cand.idx_b].is_merged)
+					return;
+				buckets[0].push_back(cand);
+				generated[0]++;
+				peak_candidates = max(peak_candidates, ++buffered);
+				if (buffered >= max_candidates)
+					commit(0);
+			});
+		}
+		commit(0);
+		log_tier(0);
+	}
 
-		lut_a.is_merged = true;
-		lut_b.is_merged = true;
-
-		vector<SigBit> new_inputs_vec;
-		SigBit sel_bit;
-
-		// --- 【核心修改：根据类型分发】 ---
-		if (best_pair.type == MergeType::SHARED_INPUTS) {
-			// --- 情况一：总输入数 <= 5 ---
-			for (const auto &sig : best_pair.union_inputs)
-				new_inputs_vec.push_back(sig);
-			// 补齐空输入（当总输入数小于5时）
-			while (new_inputs_vec.size() < 5)
-				new_inputs_vec.push_back(RTLIL::S0);
-			// 最后的一位信号为常数1作为sel_bit
-			sel_bit = RTLIL::S1;
-			new_inputs_vec.push_back(sel_bit);
-		} else { // best_pair.type == MergeType::LUT6_ABSORB
-			// --- 情况二：LUT6 吸收小 LUT ---
-			const LutInfo &lut_6 = (lut_a.size == 6) ? lut_a : lut_b;
-
-			// 1. 新的输入向量就是LUT6的原始输入向量
-			for (const auto &pair : lut_6.ordered_inputs) {
-				new_inputs_vec.push_back(pair.second);
+	// 档位 1..5：每次遍历收集 [first_tier, last_tier] 的候选，遍历结束后按档位依次提交
+	int first_tier = 1;
+	while (first_tier < NUM_CANDIDATE_TIERS) {
+		int last_tier = NUM_CANDIDATE_TIERS - 1;
+		num_sweeps++;
+		index.for_each_pair([&](int i, int j) {
+			if (luts[i].is_merged || luts[j].is_merged)
+				return;
+			pair_candidates.clear();
+			check_and_add_candidates(luts, i, j, pair_candidates);
+			for (const auto &cand : pair_candidates) {
+				int tier = candidate_tier(cand);
+				if (tier < first_tier || tier > last_tier || luts[cand.idx_a].is_merged || luts[cand.idx_b].is_merged)
+					continue;
+				buckets[tier].push_back(cand);
+				generated[tier]++;
+				peak_candidates = max(peak_candidates, ++buffered);
+				while (buffered >= max_candidates) {
+					if (last_tier > first_tier) {
+						// 放弃最低档位，下一次遍历重新生成
+						buffered -= buckets[last_tier].size();
+						generated[last_tier] = 0;
+						vector<MergeCandidate>().swap(buckets[last_tier]);
+						last_tier--;
+					} else {
+						// 只剩一个档位时提前提交一批
+						commit(first_tier);
+					}
+				}
 			}
+		});
+		for (int tier = first_tier; tier <= last_tier; ++tier) {
+			commit(tier);
+			log_tier(tier);
+		}
+		first_tier = last_tier + 1;
+	}
+	log("Streaming search committed %zu batches in %zu pair sweeps, peak %zu candidates in memory.\n", num_batches, num_sweeps,
+	    peak_candidates);
+	return plans;
+}
 
-			// 2. sel_bit 是之前已经发现并存储好的
-			sel_bit = best_pair.discovered_sel_bit;
+// =================================================================
+// 增量模式：ECO 之后只处理改动过的LUT。与改动过的cell相连的 GTP_LUT6D 先拆回 Z (GTP_LUT6) 和
+// Z5 (GTP_LUT5) 两个LUT，再只在这些LUT附近寻找候选，其余已有的合并保持不变。
+// =================================================================
+// 改动列表文件每行一个cell名，空行和 # 开头的行忽略；也接受 select -write 写出的 <模块名>/<cell名>
+pool<IdString> ReadChangedCells(Module *module, const string &filename)
+{
+	ifstream f(filename);
+	if (!f.is_open())
+		log_cmd_error("Could not open file '%s' for reading.\n", filename.c_str());
+	pool<IdString> changed;
+	string module_prefix = string(log_id(module)) + "/";
+	string line;
+	while (getline(f, line)) {
+		line.erase(0, line.find_first_not_of(" \t\r"));
+		line.erase(line.find_last_not_of(" \t\r") + 1);
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (line.compare(0, module_prefix.size(), module_prefix) == 0)
+			line.erase(0, module_prefix.size());
+		changed.insert(RTLIL::IdString(line[0] == '\\' || line[0] == '$' ? line : "\\" + line));
+	}
+	log("Read %zu changed cells from '%s'.\n", changed.size(), filename.c_str());
+	return changed;
+}
 
-			// 3. 端口映射：确保 sel_bit 在最后一位
-			auto sel_it = find(new_inputs_vec.begin(), new_inputs_vec.end(), sel_bit);
-			if (sel_it != new_inputs_vec.end())
-				iter_swap(sel_it, new_inputs_vec.end() - 1);
+void UnpackTouchedLut6D(Module *module, pool<IdString> &changed)
+{
+	SigMap sigmap(module);
+	pool<SigBit> touched_nets;
+	for (auto name : changed) {
+		Cell *cell = module->cell(name);
+		if (cell == nullptr) {
+			log_warning("Changed cell %s not found in module %s.\n", log_id(name), log_id(module));
+			continue;
 		}
+		for (const auto &conn : cell->connections())
+			for (auto bit : sigmap(conn.second))
+				if (bit.wire)
+					touched_nets.insert(bit);
+	}
 
-		// --- 公共逻辑：计算 INIT 并创建规划 ---
-		SigBit z_out_target, z5_out_target;
+	vector<Cell *> to_unpack;
+	for (Cell *cell : module->cells()) {
+		if (cell->type != ID(GTP_LUT6D))
+			continue;
+		bool touches = changed.count(cell->name);
+		for (const auto &conn : cell->connections())
+			for (auto bit : sigmap(conn.second))
+				touches |= touched_nets.count(bit) > 0;
+		if (touches)
+			to_unpack.push_back(cell);
+	}
 
-		RTLIL::Const new_init = calculate_new_init(lut_a, lut_b, new_inputs_vec, sel_bit, z_out_target, z5_out_target);
+	for (Cell *cell : to_unpack) {
+		IdString name = cell->name;
+		RTLIL::Const init_val = cell->getParam(ID::INIT);
+		SigSpec inputs[6];
+		for (int k = 0; k < 6; ++k)
+			inputs[k] = cell->getPort(IdString("\\I" + to_string(k)));
+		SigSpec z = cell->hasPort(ID(Z)) ? cell->getPort(ID(Z)) : SigSpec();
+		SigSpec z5 = cell->hasPort(ID(Z5)) ? cell->getPort(ID(Z5)) : SigSpec();
+		module->remove(cell);
+
+		if (GetSize(z) > 0) {
+			Cell *lut = module->addCell(module->uniquify(IdString(name.str() + "_z")), ID(GTP_LUT6));
+			lut->setParam(ID::INIT, init_val);
+			for (int k = 0; k < 6; ++k)
+				lut->setPort(IdString("\\I" + to_string(k)), inputs[k]);
+			lut->setPort(ID(Z), z);
+			changed.insert(lut->name);
+		}
+		if (GetSize(z5) > 0) {
+			// Z5 只看 I4..I0，真值表为 INIT[31:0]
+			Cell *lut = module->addCell(module->uniquify(IdString(name.str() + "_z5")), ID(GTP_LUT5));
+			lut->setParam(ID::INIT, init_val.extract(0, 32));
+			for (int k = 0; k < 5; ++k)
+				lut->setPort(IdString("\\I" + to_string(k)), inputs[k]);
+			lut->setPort(ID(Z), z5);
+			changed.insert(lut->name);
+		}
+	}
+	log("Unpacked %zu GTP_LUT6D cells touching the changed cells.\n", to_unpack.size());
+}
 
-		// 创建一个结构体，保存合并LUT所需要的全部信息
-		MergePlan plan;
-		// 新LUT 名字 a + b + merged
-		string new_name_str = string(log_id(lut_a.cell_ptr->name)) + "_" + string(log_id(lut_b.cell_ptr->name)) + "_merged";
-		plan.new_cell_name = module->uniquify(RTLIL::IdString("\\" + new_name_str));
-		// 新LUT 结构体真值表
-		plan.init_val = new_init;
-		// 新LUT 输入信号
-		for (size_t k = 0; k < 6; ++k)
-			plan.port_connections[IdString("\\I" + to_string(k))] = new_inputs_vec[k];
-		// 新LUT 输出
-		plan.port_connections[ID(Z)] = z_out_target;
-		plan.port_connections[ID(Z5)] = z5_out_target;
-		// 需要移除的LUT
-		plan.cell_a_to_remove = lut_a.cell_ptr->name;
-		plan.cell_b_to_remove = lut_b.cell_ptr->name;
+// 批量执行合并计划：按计划中的指针直接删除cell，端口名只构造一次，
+// 新cell的名字用同一个 NEW_ID 前缀加计数器生成，不再逐个拼接字符串和 uniquify
+void ApplyMergePlans(Module *module, const vector<MergePlan> &plans)
+{
+	for (const auto &plan : plans) {
+		module->remove(plan.cell_a);
+		module->remove(plan.cell_b);
+	}
 
-		// 保存规划
-		plans.push_back(plan);
+	static const IdString input_ports[6] = {ID(I0), ID(I1), ID(I2), ID(I3), ID(I4), ID(I5)};
+	string name_prefix = NEW_ID.str() + "_merged_";
+	for (size_t k = 0; k < plans.size(); ++k) {
+		const MergePlan &plan = plans[k];
+		// 到这里才把信号编号和真值表转换回 RTLIL
+		Cell *new_lut = module->addCell(name_prefix + to_string(k), ID(GTP_LUT6D));
+		new_lut->setParam(ID::INIT, init_to_const(plan.init_val, 64));
+		for (int i = 0; i < 6; ++i) {
+			new_lut->setPort(input_ports[i], net_bits[plan.inputs[i]]);
+		}
+		new_lut->setPort(ID(Z), net_bits[plan.z_out]);
+		new_lut->setPort(ID(Z5), net_bits[plan.z5_out]);
 	}
-	return plans;
 }
 
+// stitcher 的命令行选项
+struct StitcherOptions {
+	string dump_filename;
+	bool use_matching = false;
+	bool use_stream = false;
+	size_t max_candidates = 1000000; // 流式模式下内存中最多保存的候选数
+	bool shrink_support = true;
+	string incremental_file; // 非空时只在其中列出的cell附近增量合并
+	string stats_file;	 // 非空时把统计信息写成 JSON
+	string dump_bin_file;	 // 非空时把步骤 1.5 之后的LUT写成二进制文件
+};
+
 // 合并流程
-void StitcherMain(Module *module, const std::string &dump_filename)
+void StitcherMain(Module *module, const StitcherOptions &opts)
 {
 	// --- 总计时器 ---
 	ScopedTimer total_timer("Total StitcherMain Execution");
 
+	// === 步骤 0: 增量模式下拆开受影响的 GTP_LUT6D ===
+	bool incremental = !opts.incremental_file.empty();
+	pool<IdString> changed_cells;
+	if (incremental) {
+		ScopedTimer step0_timer("Step 0: UnpackTouchedLut6D");
+		changed_cells = ReadChangedCells(module, opts.incremental_file);
+		UnpackTouchedLut6D(module, changed_cells);
+	}
+
 	// === 步骤 1: 收集LUTs ===
 	vector<LutInfo> all_luts;
 	{ // 使用花括号创建一个新的作用域
@@ -825,19 +1254,64 @@ void StitcherMain(Module *module, const std::string &dump_filename)
 		SigMap sigmap(module);
 		CollectLuts(module, sigmap, all_luts);
 
-		if (!dump_filename.empty()) {
-			dump_luts_to_file(dump_filename, all_luts);
+		if (!opts.dump_filename.empty()) {
+			dump_luts_to_file(opts.dump_filename, all_luts);
 		}
 	} // step1_timer 在这里离开作用域，自动打印时间
 
 	log("Collected %zu LUTs.\n", all_luts.size());
 
+	vector<char> active_luts(all_luts.size(), 0);
+	if (incremental) {
+		for (size_t i = 0; i < all_luts.size(); ++i)
+			active_luts[i] = changed_cells.count(all_luts[i].cell_ptr->name) > 0;
+	}
+
+	// === 步骤 1.5: 折叠常数输入、去掉无关输入 ===
+	vector<PreShrinkInputs> pre_shrink(all_luts.size());
+	for (size_t i = 0; i < all_luts.size(); ++i) {
+		pre_shrink[i].size = all_luts[i].size;
+		copy(all_luts[i].inputs, all_luts[i].inputs + 6, pre_shrink[i].inputs);
+	}
+	{
+		ScopedTimer fold_timer("Step 1.5: FoldConstantInputs");
+		FoldConstantInputs(all_luts, incremental ? &active_luts : nullptr);
+	}
+	if (opts.shrink_support) {
+		ScopedTimer shrink_timer("Step 1.5: ShrinkLutSupport");
+		ShrinkLutSupport(all_luts, incremental ? &active_luts : nullptr);
+	}
+	if (!opts.dump_bin_file.empty())
+		dump_luts_to_binary(opts.dump_bin_file, all_luts);
+	if (stitcher_stats) {
+		// 统计每层LUT数需要深度，全局搜索和增量模式本身不计算深度
+		ScopedTimer stats_timer("Stats: NumberLutsByLevel");
+		NumberLutsByLevel(all_luts);
+		stitcher_stats->record_luts(all_luts);
+	}
+
 	// === 步骤 2: 计算深度并分区 ===
 
 	// === 【核心决策逻辑】 ===
-	priority_queue<MergeCandidate> candidates;
+	vector<MergeCandidate> candidates;
+	vector<MergePlan> plans;
 
-	if (all_luts.size() <= LAYERED_SEARCH_THRESHOLD) {
+	bool streaming = opts.use_stream && !incremental;
+	if (opts.use_stream && incremental)
+		log_warning("-stream is ignored in incremental mode.\n");
+
+	if (incremental) {
+		// --- 路径D：增量模式，只在改动过的LUT附近搜索 ---
+		ScopedTimer step3_timer("Step 3: FindMergeCandidates (Incremental)");
+		FindMergeCandidates_Incremental(all_luts, active_luts, candidates);
+		log("Found %zu potential merge candidates.\n", candidates.size());
+	} else if (streaming) {
+		// --- 路径C：流式生成并分批提交，步骤 3 和步骤 4 交替进行 ---
+		if (opts.use_matching)
+			log_warning("-matching is ignored in streaming mode, batches are committed greedily.\n");
+		ScopedTimer step34_timer("Step 3/4: StreamMerges");
+		plans = StreamMerges(all_luts, opts.max_candidates);
+	} else if (all_luts.size() <= LAYERED_SEARCH_THRESHOLD) {
 		// --- 路径A：LUT数量少，使用快速的全局搜索 ---
 
 		// 分层是不必要的，但我们仍然可以打印一条信息
@@ -880,40 +1354,40 @@ void StitcherMain(Module *module, const std::string &dump_filename)
 		}
 	}
 
+	if (!streaming) {
+		{
+			ScopedTimer absorb_timer("Step 3: FindAbsorbCandidates");
+			FindAbsorbCandidates(all_luts, candidates, incremental ? &active_luts : nullptr);
+		}
+		ScopedTimer sort_timer("Step 3: SortCandidates");
+		auto sort_start = std::chrono::high_resolution_clock::now();
+		vector<double> sort_busy;
+		SortCandidates(candidates, stitcher_stats ? &sort_busy : nullptr);
+		if (stitcher_stats) {
+			double wall_seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - sort_start).count();
+			stitcher_stats->threads.push_back({"sort_candidates", wall_seconds, sort_busy});
+		}
+	}
+
 	// === 步骤 4: 规划合并方案 ===
-	vector<MergePlan> plans;
 	{
 		ScopedTimer step4_timer("Step 4: PlanMerges");
-		plans = PlanMerges(module, all_luts, candidates);
+		if (!streaming)
+			plans = opts.use_matching ? PlanMerges_Matching(all_luts, candidates) : PlanMerges(all_luts, candidates, stitcher_stats);
 		if (plans.empty()) {
 			log("No valid merges found.\n");
 			// 函数提前结束，total_timer 会自动析构并打印总时间
 			return;
 		}
 		log("Planned %zu merges.\n", plans.size());
+		log("%zu merges exceed the input limit without the folding and shrinking of step 1.5.\n",
+		    CountShrinkEnabledMerges(all_luts, pre_shrink, plans));
 	}
 
 	// === 步骤 5: 执行合并方案 ===
 	{
 		ScopedTimer step5_timer("Step 5: ExecuteMerges (remove & add cells)");
-		pool<RTLIL::IdString> cell_names_to_remove;
-		for (const auto &plan : plans) {
-			cell_names_to_remove.insert(plan.cell_a_to_remove);
-			cell_names_to_remove.insert(plan.cell_b_to_remove);
-		}
-		for (auto cell_name : cell_names_to_remove) {
-			if (module->cell(cell_name)) {
-				module->remove(module->cell(cell_name));
-			}
-		}
-
-		for (const auto &plan : plans) {
-			Cell *new_lut = module->addCell(plan.new_cell_name, ID(GTP_LUT6D));
-			new_lut->setParam(ID::INIT, plan.init_val);
-			for (const auto &conn : plan.port_connections) {
-				new_lut->setPort(conn.first, conn.second);
-			}
-		}
+		ApplyMergePlans(module, plans);
 		log("Performed %zu merges successfully.\n", plans.size());
 	}
 
@@ -924,8 +1398,12 @@ void StitcherMain(Module *module, const std::string &dump_filename)
 struct StitcherPass : public Pass {
 	StitcherPass() : Pass("stitcher", "Basic Task: find and stitch GTP_LUTs.") {}
 
-	std::string dump_filename;
-	void clear_flags() override { dump_filename = ""; }
+	StitcherOptions opts;
+	void clear_flags() override
+	{
+		opts = StitcherOptions();
+		stitcher_stats = nullptr;
+	}
 
 	void execute(vector<string> args, RTLIL::Design *design) override
 	{
@@ -936,7 +1414,41 @@ struct StitcherPass : public Pass {
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
 			if (args[argidx] == "-dump" && argidx + 1 < args.size()) {
-				dump_filename = args[++argidx];
+				opts.dump_filename = args[++argidx];
+				continue;
+			}
+			// -dump-bin <file>: 把交给候选搜索的LUT写成二进制文件，可用 stitcher_bench 离线测试搜索和规划
+			if (args[argidx] == "-dump-bin" && argidx + 1 < args.size()) {
+				opts.dump_bin_file = args[++argidx];
+				continue;
+			}
+			// -matching: 用最大匹配代替贪心规划合并方案
+			if (args[argidx] == "-matching") {
+				opts.use_matching = true;
+				continue;
+			}
+			// -noshrink: 不去掉LUT的无关输入
+			if (args[argidx] == "-noshrink") {
+				opts.shrink_support = false;
+				continue;
+			}
+			// -stream: 按分数档位分批生成候选并立即提交；-max-candidates <n>: 流式模式下内存中最多保存的候选数
+			if (args[argidx] == "-stream") {
+				opts.use_stream = true;
+				continue;
+			}
+			if (args[argidx] == "-max-candidates" && argidx + 1 < args.size()) {
+				opts.max_candidates = max(atoll(args[++argidx].c_str()), 1LL);
+				continue;
+			}
+			// -incremental <file>: 只在文件中列出的（ECO 改动或新增的）cell 附近重新合并
+			if (args[argidx] == "-incremental" && argidx + 1 < args.size()) {
+				opts.incremental_file = args[++argidx];
+				continue;
+			}
+			// -stats <file.json>: 把LUT分布、候选、合并结果、线程忙碌时间和各步骤内存写成 JSON，格式见 StitcherStats
+			if (args[argidx] == "-stats" && argidx + 1 < args.size()) {
+				opts.stats_file = args[++argidx];
 				continue;
 			}
 			break;
@@ -949,7 +1461,13 @@ struct StitcherPass : public Pass {
 
 		// --- 关键修改：直接在顶层模块上执行，不再进行任何克隆或替换 ---
 		log("Performing in-place LUT stitching on module: %s\n", log_id(module));
-		StitcherMain(module, dump_filename);
+		StitcherStats stats;
+		if (!opts.stats_file.empty())
+			stitcher_stats = &stats;
+		StitcherMain(module, opts);
+		stitcher_stats = nullptr;
+		if (!opts.stats_file.empty())
+			stats.write_json(opts.stats_file, module);
 
 		log("Stitching complete.\n");
 	}
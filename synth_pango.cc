@@ -25,12 +25,29 @@ Implement of "Heuristics for Area Minimization in LUT-Based FPGA Technology Mapp
 #include "kernel/celltypes.h"
 #include "kernel/consteval.h"
 #include "kernel/modtools.h"
+#include "kernel/satgen.h"
 #include "kernel/sigtools.h"
 #include "kernel/yosys.h"
+#include "libs/minisat/Solver.h"
+#include <array>
 #include <queue>
+#include <random>
 #include <ranges>
 #include <string.h>
+#include <unordered_set>
+#include <filesystem>
+#include <optional>
 #include <chrono> // <-- 新增，用于计时
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MAPPER_HAS_AVX2_KERNEL
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 
 USING_YOSYS_NAMESPACE
@@ -43,9 +60,23 @@ PRIVATE_NAMESPACE_BEGIN
 size_t MAX_CUT_SIZE_PRE_CELL = 300;
 size_t MAX_INTERATIONS = 3;
 size_t LUT_SIZE = 6;
+size_t PORTFOLIO_SIZE = 1;
+// node order inside each topological level, see ReorderGates
+enum GateOrder { ORDER_TOPO, ORDER_DFS, ORDER_RCM };
+GateOrder GATE_ORDER = ORDER_TOPO;
 
-dict<SigBit, pool<SigBit>> best_bit2cut;
-size_t cur_interation = 0;
+// heuristic knobs of one mapping run, -portfolio runs several of them side by side
+struct MapperStrategy {
+	float fanout_alpha = 2.5;
+	size_t iterations = 3;
+	bool quiet = false; // worker threads must not call the (not thread safe) log functions
+};
+
+// Per-run state is thread_local: portfolio workers each own a copy, while the graph
+// (bit2driver, bit2reader, cell2bits) and the cut database (cell2cuts) are shared read-only.
+thread_local MapperStrategy cur_strategy;
+thread_local dict<SigBit, uint32_t> best_bit2cut; // covered output -> cut handle
+thread_local size_t cur_interation = 0;
 // using sigmap to get a unique name of each signal
 SigMap sigmap;
 
@@ -54,14 +85,105 @@ dict<SigBit, Cell *> bit2driver;
 dict<SigBit, vector<Cell *>> bit2reader;
 dict<Cell *, vector<SigBit>> cell2bits; // the first bit is output bits
 
-dict<Cell *, float> cell2OptDepth;
-dict<SigBit, float> bit2height;
-dict<SigBit, float> bit2depth;
-dict<SigBit, float> bit2af;
-dict<SigBit, size_t> bit2fanout_est;
-dict<Cell *, dict<pool<SigBit>, pool<Cell *>>> cell2cuts; // cell -> dict<cut, cone>
+thread_local dict<Cell *, float> cell2OptDepth;
+thread_local dict<SigBit, float> bit2height;
+thread_local vector<float> bit2depth; // indexed by bit id
+thread_local vector<float> bit2af;    // indexed by bit id
+thread_local dict<SigBit, size_t> bit2fanout_est;
+dict<Cell *, dict<uint32_t, pool<Cell *>>> cell2cuts; // cell -> dict<cut handle, cone>
+
+// Interned cut table: nodes and covers with the same leaf set share one entry and refer to it
+// by handle. The leaf ids are stored once, in handle2info; cut_table only holds handles and
+// hashes them through their leaf ids. Handles no node refers to any more are put on
+// free_handles by ReleaseDeadCuts and reused.
+struct CutInfo {
+	uint32_t size;	      // 0 for a free handle
+	uint64_t signature;   // OR of 1 << (id % 64) over the leaves, a cheap subset filter
+	vector<int> leaf_ids; // sorted bit ids
+};
+vector<CutInfo> handle2info;
+struct CutHandleHash {
+	size_t operator()(uint32_t handle) const
+	{
+		size_t h = 0;
+		for (int id : handle2info[handle].leaf_ids) {
+			h = (h ^ id) * 0x100000001B3ULL;
+		}
+		return h;
+	}
+};
+struct CutHandleEqual {
+	bool operator()(uint32_t a, uint32_t b) const { return handle2info[a].leaf_ids == handle2info[b].leaf_ids; }
+};
+std::unordered_set<uint32_t, CutHandleHash, CutHandleEqual> cut_table;
+vector<uint32_t> free_handles;
+size_t num_pruned_cuts = 0;
+size_t num_released_cuts = 0;
+
+// dense bit ids for the cost arrays, id 0 is a sentinel leaf with depth 0 and area flow 0
+dict<SigBit, int> bit2id;
+vector<SigBit> id2bit;
+
+// Leaf ids of all cuts of a node, laid out for the cut evaluation kernel: cuts are grouped
+// in blocks of CUT_LANES, and inside a block slot k of every cut is stored contiguously
+// (leaves[(block * LUT_SIZE + k) * CUT_LANES + lane]). Unused slots and lanes hold id 0.
+const size_t CUT_LANES = 8;
+struct CutArray {
+	vector<uint32_t> cuts; // cut handles
+	vector<int> leaves;
+};
+dict<Cell *, CutArray> cell2cutarray;
+
+// cut enumeration, cut evaluation and truth table code specialised on the LUT size K = 4..8,
+// GetCutKernels picks the instantiation matching LUT_SIZE at the start of a run
+struct CutKernels {
+	bool (*generate_cuts)(Cell *cell);
+	void (*eval_cuts)(const int *leaves, size_t num_blocks, const float *depth, const float *af, float *cut_depth, float *cut_af);
+	vector<bool> (*cut_init)(const vector<SigBit> &cut, SigBit out, const pool<Cell *> *cone);
+};
+CutKernels cut_kernels;
 
 bool using_internel_lut_type = false;
+// treat GTP_LUT1..8 as mappable nodes, used to re-cover an already mapped netlist
+bool remap_luts = false;
+// add balanced versions of gate trees as structural choices, see AddStructuralChoices
+bool use_choices = false;
+// re-cover the max_level paths after mapping, see ResynthesizeCriticalPaths
+bool critical_resynthesis = false;
+// rebuild the deepest windows with exact synthesis, see PlanExactWindows
+bool exact_synthesis = false;
+int64_t EXACT_CONFLICT_BUDGET = 20000;
+
+// default values of the mapping options, called by every pass before it parses its arguments
+// so no option leaks from an earlier mapper call in the same session
+void ResetMapperOptions()
+{
+	MAX_CUT_SIZE_PRE_CELL = 300;
+	MAX_INTERATIONS = 3;
+	LUT_SIZE = 6;
+	PORTFOLIO_SIZE = 1;
+	GATE_ORDER = ORDER_TOPO;
+	using_internel_lut_type = false;
+	remap_luts = false;
+	use_choices = false;
+	critical_resynthesis = false;
+	exact_synthesis = false;
+	EXACT_CONFLICT_BUDGET = 20000;
+}
+// LUT network found for one window, LUT inputs are window input indexes, or
+// n + i for the output of luts[i]. The last LUT drives out.
+struct ExactLut {
+	vector<int> inputs;
+	vector<bool> init;
+};
+struct ExactNetwork {
+	SigBit out;
+	vector<SigBit> inputs;
+	vector<ExactLut> luts;
+	pool<SigBit> window_outs; // covered outputs inside the window besides out
+};
+dict<SigBit, vector<SigBit>> bit2choices; // bit -> equivalent bits of the other structural version
+pool<Cell *> choice_gates;
 //-------------------------------
 // functions declare here
 bool MapperMain(Module *module);
@@ -70,12 +192,26 @@ void SetPangoCellTypes(CellTypes *);
 bool CheckCellWidth(Module *module);
 bool GetPrimeInputOuput(Module *module, pool<SigBit> &inputs, pool<SigBit> &outputs);
 bool GenerateCuts(Module *module);
-bool TraverseBWD(Module *module, const pool<SigBit> &, dict<SigBit, pool<SigBit>> &);
-bool TraverseFWD(Module *module, const pool<SigBit> &, dict<SigBit, pool<SigBit>> &);
-bool ConeToLUTs(Module *module, dict<SigBit, pool<SigBit>> &bit2cut);
+void BuildCutArrays(const vector<Cell *> &gates);
+void ReleaseDeadCuts();
+void LogCutTableStats();
+vector<SigBit> GetCutLeaves(uint32_t handle);
+void PlanExactWindows(const vector<Cell *> &gates, const dict<SigBit, uint32_t> &cover, vector<ExactNetwork> &networks);
+void InstantiateExactWindows(Module *module, const vector<ExactNetwork> &networks);
+IdString GetLutType(size_t size);
+bool GenerateCuts(Cell *cell);
+void PruneDominatedCuts(Cell *cell);
+void BuildCutArray(Cell *cell);
+bool GetBestCut(Cell *cell, uint32_t &cut_selected);
+bool UpdateCutDepthAf(uint32_t cut_selected, Cell *cell, SigBit outbit);
+CutKernels GetCutKernels(size_t lut_size);
+bool TraverseBWD(const vector<Cell *> &gates, const pool<SigBit> &, dict<SigBit, uint32_t> &);
+bool TraverseFWD(const vector<Cell *> &gates, const pool<SigBit> &, dict<SigBit, uint32_t> &, bool generate_cuts = false);
+bool ConeToLUTs(Module *module, dict<SigBit, uint32_t> &bit2cut);
 float GetEstimatedFanout(SigBit bit);
 
 pool<Cell *> GetReaders(Cell *cell, RTLIL::IdString port = RTLIL::IdString());
+int GetBitId(SigBit bit);
 
 
 #pragma region cell_type_check
@@ -116,8 +252,8 @@ int IsGTP_LUT(Cell *cell)
 	const char *type_str = cell->type.c_str();
 	if (0 == strncmp(type_str, "\\GTP_LUT", 8)) {
 		if (strlen(cell->type.c_str()) == 8 + 1) {
-			int size = type_str[8] - '1';
-			if ((size < 0 || size > 6)) {
+			int size = type_str[8] - '0';
+			if ((size < 1 || size > 8)) {
 				return 0;
 			}
 			return size;
@@ -132,7 +268,10 @@ bool IsGTP_LUT6D(Cell *cell)
 	return true;
 }
 bool IsGTP(Cell *cell) { return cell->type.begins_with("\\GTP_"); }
-bool IsCombinationalGate(Cell *cell) { return IsAND(cell) || IsOR(cell) || IsNOT(cell) || IsMUX(cell) || IsXOR(cell); }
+bool IsCombinationalGate(Cell *cell)
+{
+	return IsAND(cell) || IsOR(cell) || IsNOT(cell) || IsMUX(cell) || IsXOR(cell) || (remap_luts && IsGTP_LUT(cell));
+}
 bool IsCombinationalCell(Cell *cell)
 {
 	return IsAND(cell) || IsOR(cell) || IsNOT(cell) || IsMUX(cell) || IsXOR(cell) || IsGTP_LUT(cell) || IsGTP_LUT6D(cell);
@@ -140,17 +279,20 @@ bool IsCombinationalCell(Cell *cell)
 
 #pragma endregion cell_type_check
 
+// output pin name of a mappable node
+IdString GetCellOutputPort(Cell *cell) { return IsGTP_LUT(cell) ? ID(Z) : ID(Y); }
+
 // only return this first sigbit connect to cell
 SigBit GetCellOutput(Cell *cell)
 {
 	log_assert(cell && cell2bits.count(cell));
-	auto &bits = cell2bits[cell];
+	const vector<SigBit> &bits = cell2bits.at(cell);
 	return bits[0];
 }
 void GetCellInputsSet(Cell *cell, pool<SigBit> &inputs)
 {
 	log_assert(cell && inputs.empty() && cell2bits.count(cell));
-	auto &bits = cell2bits[cell];
+	const vector<SigBit> &bits = cell2bits.at(cell);
 	int offset = 1;
 	// not support GTP_LUT6D now
 	// if(cell is dual output)
@@ -162,7 +304,7 @@ void GetCellInputsSet(Cell *cell, pool<SigBit> &inputs)
 void GetCellInputsVector(Cell *cell, vector<SigBit> &inputs)
 {
 	log_assert(cell && inputs.empty() && cell2bits.count(cell));
-	auto &bits = cell2bits[cell];
+	const vector<SigBit> &bits = cell2bits.at(cell);
 	int offset = 1;
 	// not support GTP_LUT6D now
 	// if(cell is dual output)
@@ -203,6 +345,9 @@ bool GetPrimeInputOuput(Module *module, pool<SigBit> &inputs, pool<SigBit> &outp
 			IdString portname = conn.first;
 			RTLIL::SigSpec sig = sigmap(conn.second);
 			if (yosys_celltypes.cell_output(cell->type, portname)) {
+				if (choice_gates.count(cell)) {
+					continue; // only read by other choice gates, never a netlist output
+				}
 				pool<Cell *> readers = GetReaders(cell, portname);
 				for (Cell *reader : readers) {
 					if (!IsCombinationalGate(reader)) {
@@ -277,7 +422,7 @@ void GetTopoSortedGates(Module *module, vector<Cell *> &gates)
 		}
 		gates.push_back(current);
 		visited.insert(current);
-		auto rds = GetReaders(current, ID(Y)); // combination gate output pin are Y
+		auto rds = GetReaders(current, GetCellOutputPort(current));
 		for (Cell *neighbor : rds) {
 			if (!IsCombinationalGate(current)) {
 				continue;
@@ -293,26 +438,223 @@ void GetTopoSortedGates(Module *module, vector<Cell *> &gates)
 	}
 }
 
-bool MapperMain(Module *module)
+// Renumber the gates, and with them the bit ids, so that fanins sit close to their readers
+// in the dense arrays. Gates stay grouped by topological level; inside a level they follow
+// a DFS post-order from the outputs (-order dfs) or a reverse Cuthill-McKee order of the
+// undirected gate graph (-order rcm).
+void ReorderGates(vector<Cell *> &gates)
 {
-	CheckCellWidth(module);
-	vector<Cell *> gates;
-	GetTopoSortedGates(module, gates);
-	GenerateCuts(module);
-	pool<SigBit> prime_inputs;
-	pool<SigBit> prime_outputs;
-	GetPrimeInputOuput(module, prime_inputs, prime_outputs);
-	log_debug("found %ld prime input and %ld prime output\n", prime_inputs.size(), prime_outputs.size());
+	if (GATE_ORDER == ORDER_TOPO) {
+		return;
+	}
+	dict<Cell *, int> level;
+	dict<Cell *, vector<Cell *>> fanins;
+	dict<Cell *, vector<Cell *>> neighbors;
+	for (Cell *cell : gates) {
+		vector<SigBit> inputs;
+		GetCellInputsVector(cell, inputs);
+		int lvl = 0;
+		for (auto &bit : inputs) {
+			Cell *drv = bit2driver.count(bit) ? bit2driver.at(bit) : nullptr;
+			if (!drv || !level.count(drv)) {
+				continue;
+			}
+			lvl = max(lvl, level.at(drv) + 1);
+			fanins[cell].push_back(drv);
+			neighbors[cell].push_back(drv);
+			neighbors[drv].push_back(cell);
+		}
+		level[cell] = lvl;
+	}
+
+	vector<Cell *> order;
+	pool<Cell *> visited;
+	if (GATE_ORDER == ORDER_DFS) {
+		// iterative post-order, roots are taken from the end of the topological order
+		vector<pair<Cell *, size_t>> stack;
+		for (auto it = gates.rbegin(); it != gates.rend(); ++it) {
+			if (visited.count(*it)) {
+				continue;
+			}
+			visited.insert(*it);
+			stack.push_back({*it, 0});
+			while (!stack.empty()) {
+				Cell *cell = stack.back().first;
+				size_t &next = stack.back().second;
+				const vector<Cell *> &fi = fanins[cell];
+				if (next < fi.size()) {
+					Cell *drv = fi[next++];
+					if (!visited.count(drv)) {
+						visited.insert(drv);
+						stack.push_back({drv, 0});
+					}
+					continue;
+				}
+				order.push_back(cell);
+				stack.pop_back();
+			}
+		}
+	} else {
+		// Cuthill-McKee: BFS from a minimum degree node of each component,
+		// neighbors are visited by increasing degree, the result is reversed.
+		// degrees are looked up read-only, operator[] in a comparator would insert into neighbors
+		dict<Cell *, size_t> degree;
+		for (Cell *cell : gates) {
+			degree[cell] = neighbors.count(cell) ? neighbors.at(cell).size() : 0;
+		}
+		auto by_degree_less = [&](Cell *a, Cell *b) { return degree.at(a) < degree.at(b); };
+		vector<Cell *> by_degree = gates;
+		std::stable_sort(by_degree.begin(), by_degree.end(), by_degree_less);
+		for (Cell *start : by_degree) {
+			if (visited.count(start)) {
+				continue;
+			}
+			visited.insert(start);
+			size_t head = order.size();
+			order.push_back(start);
+			while (head < order.size()) {
+				Cell *cell = order[head++];
+				if (!degree.at(cell)) {
+					continue;
+				}
+				vector<Cell *> next;
+				for (Cell *nb : neighbors.at(cell)) {
+					if (!visited.count(nb)) {
+						visited.insert(nb);
+						next.push_back(nb);
+					}
+				}
+				std::stable_sort(next.begin(), next.end(), by_degree_less);
+				order.insert(order.end(), next.begin(), next.end());
+			}
+		}
+		std::reverse(order.begin(), order.end());
+	}
+
+	dict<Cell *, size_t> rank;
+	for (size_t i = 0; i < order.size(); i++) {
+		rank[order[i]] = i;
+	}
+	std::stable_sort(gates.begin(), gates.end(), [&](Cell *a, Cell *b) {
+		int la = level.at(a), lb = level.at(b);
+		return la != lb ? la < lb : rank.at(a) < rank.at(b);
+	});
+
+	// number the bits in the new gate order, bits only seen by GTP cells go last
+	id2bit.clear();
+	bit2id.clear();
+	id2bit.push_back(SigBit());
+	auto number = [&](SigBit bit) {
+		if (!bit2id.count(bit)) {
+			bit2id[bit] = id2bit.size();
+			id2bit.push_back(bit);
+		}
+	};
+	for (Cell *cell : gates) {
+		vector<SigBit> inputs;
+		GetCellInputsVector(cell, inputs);
+		for (auto &bit : inputs) {
+			number(bit);
+		}
+		number(GetCellOutput(cell));
+	}
+	for (auto &it : cell2bits) {
+		for (auto &bit : it.second) {
+			number(bit);
+		}
+	}
+}
+
+// Hardware cache counters of the calling thread (and the threads it starts later) around the
+// mapping traversals, so the -order bench compares the orders inside one yosys run. Without
+// perf_event_open access (perf_event_paranoid, containers, other systems) nothing is counted.
+struct CacheCounters {
+	static const int NUM_EVENTS = 2;
+	int fds[NUM_EVENTS] = {-1, -1};
+
+	void start()
+	{
+#ifdef __linux__
+		const uint64_t configs[NUM_EVENTS] = {PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+		for (int i = 0; i < NUM_EVENTS; i++) {
+			struct perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = 1;
+			attr.inherit = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+		if (fds[0] < 0 || fds[1] < 0) {
+			close_counters();
+			return;
+		}
+		for (int i = 0; i < NUM_EVENTS; i++) {
+			ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+			ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	// returns false when the counters could not be opened
+	bool stop(uint64_t values[NUM_EVENTS])
+	{
+		bool ok = fds[0] >= 0 && fds[1] >= 0;
+#ifdef __linux__
+		for (int i = 0; i < NUM_EVENTS && ok; i++) {
+			ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+			ok = read(fds[i], &values[i], sizeof(uint64_t)) == sizeof(uint64_t);
+		}
+#endif
+		close_counters();
+		return ok;
+	}
+
+	void close_counters()
+	{
+#ifdef __linux__
+		for (int i = 0; i < NUM_EVENTS; i++) {
+			if (fds[i] >= 0) {
+				close(fds[i]);
+			}
+			fds[i] = -1;
+		}
+#endif
+	}
+};
+
+void ResetMappingState()
+{
+	best_bit2cut.clear();
+	cur_interation = 0;
+	cell2OptDepth.clear();
+	bit2height.clear();
+	bit2depth.assign(id2bit.size(), 0.0);
+	bit2af.assign(id2bit.size(), 0.0);
+	bit2fanout_est.clear();
+}
+
+// run the depth oriented pass followed by the area recovery passes of cur_strategy,
+// the best cover is left in best_bit2cut
+void RunMapping(const vector<Cell *> &gates, const pool<SigBit> &prime_inputs, const pool<SigBit> &prime_outputs)
+{
+	ResetMappingState();
 	// init fanout, oedges(v)
 	for (auto &p : bit2reader) {
 		bit2fanout_est[p.first] = p.second.size();
 	}
-	dict<SigBit, pool<SigBit>> bit2cut;
-	for (cur_interation = 0; cur_interation < MAX_INTERATIONS; cur_interation++) {
+	dict<SigBit, uint32_t> bit2cut;
+	for (cur_interation = 0; cur_interation < cur_strategy.iterations; cur_interation++) {
 		bit2cut.clear();
-		TraverseFWD(module, prime_inputs, bit2cut);
-		TraverseBWD(module, prime_outputs, bit2cut);
-		log_debug("iteration = %ld  cut_num = %ld\n", cur_interation, bit2cut.size());
+		// without a prebuilt cut database the first forward pass enumerates the cuts itself
+		TraverseFWD(gates, prime_inputs, bit2cut, cur_interation == 0 && cell2cuts.empty());
+		TraverseBWD(gates, prime_outputs, bit2cut);
+		if (!cur_strategy.quiet) {
+			log_debug("iteration = %ld  cut_num = %ld\n", cur_interation, bit2cut.size());
+		}
 		if (best_bit2cut.size() == 0 || bit2cut.size() < best_bit2cut.size()) {
 			best_bit2cut = bit2cut;
 		}
@@ -329,7 +671,7 @@ bool MapperMain(Module *module)
 				pool<SigBit> inputs;
 				GetCellInputsSet(cell, inputs);
 				for (auto bit : inputs) {
-					Cell *drv = bit2driver.count(bit) ? bit2driver[bit] : nullptr;
+					Cell *drv = bit2driver.count(bit) ? bit2driver.at(bit) : nullptr;
 					if (!drv) {
 						continue;
 					}
@@ -340,157 +682,952 @@ bool MapperMain(Module *module)
 			for (auto it = gates.rbegin(); it != gates.rend(); ++it) {
 				Cell *cell = *it;
 				SigBit bit = GetCellOutput(cell);
-				Cell *drv = bit2driver.count(bit) ? bit2driver[bit] : nullptr;
+				Cell *drv = bit2driver.count(bit) ? bit2driver.at(bit) : nullptr;
 				if (!drv || !prime_outputs.count(bit)) {
 					continue;
 				}
-				MarkODepth(drv, bit2depth[bit]);
+				MarkODepth(drv, bit2depth[GetBitId(bit)]);
 			}
 		}
 	}
-	log_debug("Map cut to GTP_LUT\n");
-	ConeToLUTs(module, best_bit2cut);
-	return true;
 }
 
-// -----------------------
-bool MapperInit(Module *module)
+// LUT level of every covered output, counted from the prime inputs
+void GetCoverLevels(const vector<Cell *> &gates, const dict<SigBit, uint32_t> &bit2cut, dict<SigBit, int> &bit2level)
 {
-	log_debug("Pango init\n");
-	SetPangoCellTypes(&yosys_celltypes);
+	for (Cell *cell : gates) {
+		SigBit outbit = GetCellOutput(cell);
+		auto it = bit2cut.find(outbit);
+		if (it == bit2cut.end()) {
+			continue;
+		}
+		int level = 0;
+		for (int id : handle2info[it->second].leaf_ids) {
+			auto lit = bit2level.find(id2bit[id]);
+			level = max(level, lit == bit2level.end() ? 0 : lit->second);
+		}
+		bit2level[outbit] = level + 1;
+	}
+}
 
-	best_bit2cut.clear();
-	cur_interation = 0;
-	bit2driver.clear();
-	bit2reader.clear();
-	cell2bits.clear();
+// cost of a cover with the formula of score.cc: (max_level / 20 + 1) * luts * 10 + pins.
+// Levels are counted from the prime inputs, which is the part the mapper can change.
+int GetCoverCost(const vector<Cell *> &gates, const dict<SigBit, uint32_t> &bit2cut, int &max_level)
+{
+	dict<SigBit, int> bit2level;
+	GetCoverLevels(gates, bit2cut, bit2level);
+	int num_of_luts = 0;
+	int num_of_pins = 0;
+	max_level = 0;
+	for (auto &p : bit2cut) {
+		max_level = max(max_level, bit2level.at(p.first));
+		num_of_luts += 1;
+		num_of_pins += handle2info[p.second].size;
+	}
+	int cost = (max_level / 20.0 + 1) * num_of_luts * 10 + num_of_pins;
+	return cost;
+}
 
-	cell2OptDepth.clear();
-	bit2height.clear();
-	bit2depth.clear();
-	bit2af.clear();
-	bit2fanout_est.clear();
-	cell2cuts.clear();
-	sigmap.set(module); //别名统一
+MapperStrategy GetPortfolioStrategy(size_t index)
+{
+	const float alphas[] = {2.5, 1.0, 5.0, 0.5, 10.0, 1.5, 3.5, 0.25};
+	const size_t num_alphas = sizeof(alphas) / sizeof(alphas[0]);
+	MapperStrategy strategy;
+	strategy.fanout_alpha = alphas[index % num_alphas];
+	strategy.iterations = MAX_INTERATIONS + 2 * ((index / num_alphas + index % 2) % 3);
+	strategy.quiet = true;
+	return strategy;
+}
+
+// hashlib containers rehash lazily on the first lookup after inserts, so touch every
+// shared table once before the worker threads read them concurrently
+void WarmupSharedTables(const vector<Cell *> &gates, const pool<SigBit> &prime_inputs, const pool<SigBit> &prime_outputs)
+{
+	SigBit probe;
+	bit2driver.count(probe);
+	bit2reader.count(probe);
+	prime_inputs.count(probe);
+	prime_outputs.count(probe);
+	cell2bits.count(nullptr);
+	cell2cuts.count(nullptr);
+	bit2id.count(probe);
+	bit2choices.count(probe);
+	cell2cutarray.count(nullptr);
+	for (Cell *cell : gates) {
+		cell2cuts.at(cell).count(0);
+	}
+}
+
+// map with several strategies concurrently and keep the cover with the lowest score
+void RunPortfolio(const vector<Cell *> &gates, const pool<SigBit> &prime_inputs, const pool<SigBit> &prime_outputs)
+{
+	size_t num = PORTFOLIO_SIZE;
+	WarmupSharedTables(gates, prime_inputs, prime_outputs);
+	vector<dict<SigBit, uint32_t>> results(num);
+	vector<int> costs(num, 0);
+	vector<int> levels(num, 0);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num)
+	for (int i = 0; i < int(num); i++) {
+		cur_strategy = GetPortfolioStrategy(i);
+		RunMapping(gates, prime_inputs, prime_outputs);
+		costs[i] = GetCoverCost(gates, best_bit2cut, levels[i]);
+		results[i] = std::move(best_bit2cut);
+		ResetMappingState();
+	}
+
+	size_t winner = 0;
+	for (size_t i = 0; i < num; i++) {
+		MapperStrategy strategy = GetPortfolioStrategy(i);
+		log("portfolio strategy %ld: alpha = %.2f iterations = %ld luts = %ld max_level = %d cost = %d\n", i, strategy.fanout_alpha,
+		    strategy.iterations, results[i].size(), levels[i], costs[i]);
+		if (costs[i] < costs[winner]) {
+			winner = i;
+		}
+	}
+	log("portfolio winner: strategy %ld with cost %d\n", winner, costs[winner]);
+	cur_strategy = MapperStrategy();
+	best_bit2cut = std::move(results[winner]);
+}
+
+// single bit AND/OR/XOR/NOT/MUX gate or buffer the sweep may fold, GTP cells are never touched
+bool IsSweepGate(Cell *cell)
+{
+	if (IsGTP(cell) || (!IsCombinationalGate(cell) && cell->type != ID($_BUF_))) {
+		return false;
+	}
+	for (auto &conn : cell->connections()) {
+		if (conn.second.size() != 1) {
+			return false;
+		}
+	}
 	return true;
 }
 
-/*
-specify port dirction of each cell for yosys_celltypes/modwalker to
-delcare the input and output pin name of gtp cell
-after that, using yosys_celltypes.cell_output(cell->type,portname) to get port direction
-*/
-void SetPangoCellTypes(CellTypes *ct)
+// Linear sweep at the start of mapping: fold gates with constant inputs (literals and
+// GTP_ONE/GTP_ZERO outputs), collapse double inversions, buffers and gates with identical
+// inputs, then drop gates that reach no GTP cell or port. Folding runs on a worklist, a folded
+// gate only requeues the gates reading its output.
+void SweepNetlist(Module *module)
 {
-	ct->setup_type(ID(GTP_ADC_E2),
-		       {ID(VA), ID(VAUX), ID(DCLK), ID(DADDR), ID(DEN), ID(SECEN), ID(DWE), ID(DI), ID(CONVST), ID(RST_N), ID(LOADSC_N)},
-		       {ID(DO), ID(DRDY), ID(OVER_TEMP), ID(LOGIC_DONE_A), ID(LOGIC_DONE_B), ID(ADC_CLK_OUT), ID(DMODIFIED), ID(ALARM)}, false);
-	ct->setup_type(ID(GTP_APM_E2), {ID(CIN),   ID(CPI),   ID(CXI),	ID(CXBI),  ID(X),	 ID(XB),	ID(Y),	      ID(Z),	   ID(MODEIN),
-					ID(MODEY), ID(MODEZ), ID(CLK),	ID(CEX1),  ID(CEX2),	 ID(CEX3),	ID(CEXB),     ID(CEY1),	   ID(CEY2),
-					ID(CEZ),   ID(CEM),   ID(CEP),	ID(CEPRE), ID(CEMODEIN), ID(CEMODEY),	ID(CEMODEZ),  ID(RSTX),	   ID(RSTXB),
-					ID(RSTY),  ID(RSTZ),  ID(RSTM), ID(RSTP),  ID(RSTPRE),	 ID(RSTMODEIN), ID(RSTMODEY), ID(RSTMODEZ)},
-		       {ID(COUT), ID(CPO), ID(CXO), ID(CXBO), ID(P)}, false);
-	ct->setup_type(ID(GTP_BUF), {ID(I)}, {ID(Z)}, false);
-	ct->setup_type(ID(GTP_CFGCLK), {ID(CLKIN), ID(CE_N)}, {}, false);
-	ct->setup_type(ID(GTP_CLKBUFCE), {ID(CE), ID(CLKIN)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFG), {ID(CLKIN)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFGCE), {ID(CLKIN), ID(CE)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFGMUX), {ID(CLKIN0), ID(CLKIN1), ID(SEL)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFGMUX_E1), {ID(CLKIN0), ID(CLKIN1), ID(SEL), ID(EN)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFGMUX_E2), {ID(CLKIN0), ID(CLKIN1), ID(DETECT_CLK0), ID(DETECT_CLK1), ID(SEL)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFM), {ID(CLKIN)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFMCE), {ID(CLKIN), ID(CE)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFR), {ID(CLKIN)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFX), {ID(CLKIN)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKBUFXCE), {ID(CLKIN), ID(CE)}, {ID(CLKOUT)}, false);
-	ct->setup_type(ID(GTP_CLKPD), {ID(RST), ID(CLK_SAMPLE), ID(CLK_CTRL), ID(CLK_PHY), ID(DONE)}, {ID(FLAG_PD), ID(LOCK)}, false);
-	ct->setup_type(ID(GTP_DDC_E2),
-		       {ID(RST), ID(RST_TRAINING_N), ID(CLKA), ID(CLKB), ID(DQSI), ID(DQSIB), ID(DELAY_STEP0), ID(DELAY_STEP1), ID(DELAY_STEP2),
-			ID(DELAY_STEP3), ID(DELAY_STEP4), ID(DQS_GATE_CTRL), ID(GATE_SEL), ID(CLK_GATE_CTRL), ID(CLKA_GATE)},
-		       {ID(WCLK), ID(WCLK_DELAY), ID(DQSI_DELAY), ID(DQSIB_DELAY), ID(DGTS), ID(IFIFO_WADDR), ID(IFIFO_RADDR), ID(READ_VALID),
-			ID(DQS_DRIFT), ID(DRIFT_DETECT_ERR), ID(DQS_DRIFT_STATUS), ID(DQS_SAMPLE)},
-		       false);
-	ct->setup_type(ID(GTP_DDC_E2_DFT),
-		       {ID(RST), ID(RST_TRAINING_N), ID(CLKA), ID(CLKB), ID(DQSI), ID(DQSIB), ID(DELAY_STEP0), ID(DELAY_STEP1), ID(DELAY_STEP2),
-			ID(DELAY_STEP3), ID(DELAY_STEP4), ID(DQS_GATE_CTRL), ID(GATE_SEL), ID(CLK_GATE_CTRL), ID(CLKA_GATE)},
-		       {ID(WCLK), ID(WCLK_DELAY), ID(DQSI_DELAY), ID(DQSIB_DELAY), ID(DGTS), ID(IFIFO_WADDR), ID(IFIFO_RADDR), ID(READ_VALID),
-			ID(DQS_DRIFT), ID(DRIFT_DETECT_ERR), ID(DQS_DRIFT_STATUS), ID(DQS_SAMPLE), ID(GATE_HIGHB), ID(GATE_HIGH_LATCHB)},
-		       false);
-	ct->setup_type(ID(GTP_DDC_E3),
-		       {ID(RST), ID(RST_TRAINING_N), ID(CLKA), ID(CLKB), ID(DQSI), ID(DQSIB), ID(DELAY_STEP0), ID(DELAY_STEP1), ID(DELAY_STEP2),
-			ID(DELAY_STEP3), ID(DELAY_STEP4), ID(DQS_GATE_CTRL), ID(GATE_SEL), ID(CLK_GATE_CTRL), ID(CLKA_GATE)},
-		       {ID(WCLK), ID(WCLK_DELAY), ID(DQSI_DELAY), ID(DQSIB_DELAY), ID(DGTS), ID(IFIFO_WADDR), ID(IFIFO_RADDR), ID(READ_VALID),
-			ID(DQS_DRIFT), ID(DRIFT_DETECT_ERR), ID(DQS_DRIFT_STATUS), ID(DQS_SAMPLE)},
-		       false);
-	ct->setup_type(ID(GTP_DFF), {ID(D), ID(CLK)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_C), {ID(D), ID(CLK), ID(C)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_CE), {ID(D), ID(CLK), ID(C), ID(CE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_E), {ID(D), ID(CLK), ID(CE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_P), {ID(D), ID(CLK), ID(P)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_PE), {ID(D), ID(CLK), ID(P), ID(CE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_R), {ID(D), ID(CLK), ID(R)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_RE), {ID(D), ID(CLK), ID(R), ID(CE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_S), {ID(D), ID(CLK), ID(S)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DFF_SE), {ID(D), ID(CLK), ID(S), ID(CE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DLATCH), {ID(D), ID(G)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DLATCH_C), {ID(D), ID(G), ID(C)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DLATCH_CE), {ID(D), ID(G), ID(C), ID(GE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DLATCH_E), {ID(D), ID(G), ID(GE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DLATCH_P), {ID(D), ID(G), ID(P)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DLATCH_PE), {ID(D), ID(G), ID(P), ID(GE)}, {ID(Q)}, false);
-	ct->setup_type(ID(GTP_DLL_E2), {ID(CLKIN), ID(SYS_CLK), ID(PWD), ID(RST), ID(UPDATE_N)}, {ID(DELAY_STEP), ID(DELAY_STEP1), ID(LOCK)}, false);
-	ct->setup_type(ID(GTP_DRM18K_E1),
-		       {ID(DIA), ID(DIB), ID(ADDRA), ID(ADDRA_HOLD), ID(ADDRB), ID(ADDRB_HOLD), ID(BWEA), ID(BWEB), ID(CLKA), ID(CLKB), ID(CEA),
-			ID(CEB), ID(WEA), ID(WEB), ID(ORCEA), ID(ORCEB), ID(RSTA), ID(RSTB)},
-		       {ID(DOA), ID(DOB)}, false);
-	ct->setup_type(ID(GTP_DRM36K_E1),
-		       {ID(CINA),  ID(CINB),  ID(DIA),	ID(DIB),  ID(ADDRA),	      ID(ADDRA_HOLD),	 ID(ADDRB), ID(ADDRB_HOLD), ID(CSA),
-			ID(CSB),   ID(BWEA),  ID(BWEB), ID(CLKA), ID(CLKB),	      ID(CEA),		 ID(CEB),   ID(WEA),	    ID(WEB),
-			ID(ORCEA), ID(ORCEB), ID(RSTA), ID(RSTB), ID(INJECT_SBITERR), ID(INJECT_DBITERR)},
-		       {ID(COUTA), ID(COUTB), ID(DOA), ID(DOB), ID(ECC_SBITERR), ID(ECC_DBITERR), ID(ECC_RDADDR), ID(ECC_PARITY)}, false);
-	ct->setup_type(ID(GTP_EFUSECODE), {}, {ID(EFUSE_CODE)}, false);
-	ct->setup_type(ID(GTP_FIFO18K_E1), {ID(DI), ID(WCLK), ID(RCLK), ID(WCE), ID(RCE), ID(ORCE), ID(RST)},
-		       {ID(ALMOST_EMPTY), ID(ALMOST_FULL), ID(EMPTY), ID(FULL), ID(DO)}, false);
-	ct->setup_type(ID(GTP_FIFO36K_E1), {ID(DI), ID(WCLK), ID(RCLK), ID(WCE), ID(RCE), ID(ORCE), ID(RST), ID(INJECT_SBITERR), ID(INJECT_DBITERR)},
-		       {ID(ALMOST_EMPTY), ID(ALMOST_FULL), ID(EMPTY), ID(FULL), ID(DO), ID(ECC_SBITERR), ID(ECC_DBITERR)}, false);
-	ct->setup_type(ID(GTP_GPLL), {ID(CLKIN1),      ID(CLKIN2),	ID(CLKFB),	 ID(CLKIN_SEL),	  ID(DPS_CLK),	   ID(DPS_EN),
-				      ID(DPS_DIR),     ID(CLKOUT0_SYN), ID(CLKOUT1_SYN), ID(CLKOUT2_SYN), ID(CLKOUT3_SYN), ID(CLKOUT4_SYN),
-				      ID(CLKOUT5_SYN), ID(CLKOUT6_SYN), ID(CLKOUTF_SYN), ID(PLL_PWD),	  ID(RST),	   ID(APB_CLK),
-				      ID(APB_RST_N),   ID(APB_ADDR),	ID(APB_SEL),	 ID(APB_EN),	  ID(APB_WRITE),   ID(APB_WDATA)},
-		       {ID(CLKOUT0), ID(CLKOUT0N), ID(CLKOUT1), ID(CLKOUT1N), ID(CLKOUT2), ID(CLKOUT2N), ID(CLKOUT3), ID(CLKOUT3N), ID(CLKOUT4),
-			ID(CLKOUT5), ID(CLKOUT6), ID(CLKOUTF), ID(CLKOUTFN), ID(LOCK), ID(DPS_DONE), ID(APB_RDATA), ID(APB_READY)},
-		       false);
-	ct->setup_type(ID(GTP_GRS), {ID(GRS_N)}, {}, false);
-	ct->setup_type(ID(GTP_HPIO_VREF), {ID(CODE_VREF0), ID(CODE_VREF1), ID(CODE_VREF2), ID(CODE_VREF3)}, {}, false);
-	ct->setup_type(ID(GTP_HSSTHP_BUFDS), {ID(COM_POWERDOWN), ID(PAD_REFCLKP), ID(PAD_REFCLKN)}, {ID(REFCLK_OUTP), ID(PMA_REFCLK_TO_FABRIC)},
-		       false);
-	ct->setup_type(ID(GTP_HSSTHP_HPLL),
-		       {ID(P_CFG_RST_HPLL),
-			ID(P_CFG_CLK_HPLL),
-			ID(P_CFG_PSEL_HPLL),
-			ID(P_CFG_ENABLE_HPLL),
-			ID(P_CFG_WRITE_HPLL),
-			ID(P_CFG_ADDR_HPLL),
-			ID(P_CFG_WDATA_HPLL),
-			ID(P_HPLL_POWERDOWN),
-			ID(P_HPLL_RST),
-			ID(P_HPLL_LOCKDET_RST),
-			ID(P_RES_CAL_RST),
-			ID(P_TX_SYNC),
-			ID(P_HPLL_DIV_SYNC),
-			ID(P_REFCLK_DIV_SYNC),
-			ID(P_HPLL_VCO_CALIB_EN),
-			ID(P_RESCAL_I_CODE_I),
-			ID(P_HPLL_DIV_CHANGE),
-			ID(P_HPLL_REFCLK_I),
-			ID(REFCLK_TO_TX_SYNC_I),
-			ID(REFCLK_TO_REFCLK_SYNC_I),
-			ID(REFCLK_TO_DIV_SYNC_I),
-			ID(ANA_TX_SYNC_I),
-			ID(ANA_HPLL_REFCLK_SYNC_I),
-			ID(ANA_HPLL_DIV_SYNC_I),
-			ID(P_PLL_REFCLK6_I),
-			ID(REFCLK0),
+	sigmap.set(module);
+	// constant value of a bit, the GTP_ONE/GTP_ZERO outputs are reused as constant sources
+	dict<SigBit, State> bit2const;
+	SigBit const_src[2] = {SigBit(State::S0), SigBit(State::S1)};
+	for (Cell *cell : module->cells()) {
+		if ((cell->type == ID(GTP_ZERO) || cell->type == ID(GTP_ONE)) && cell->hasPort(ID(Z)) && cell->getPort(ID(Z)).size() == 1) {
+			State val = cell->type == ID(GTP_ONE) ? State::S1 : State::S0;
+			SigBit bit = sigmap(cell->getPort(ID(Z)))[0];
+			bit2const[bit] = val;
+			const_src[val == State::S1] = bit;
+		}
+	}
+	auto get_const = [&](SigBit bit) {
+		bit = sigmap(bit);
+		if (!bit.wire) {
+			return (bit.data == State::S0 || bit.data == State::S1) ? bit.data : State::Sx;
+		}
+		auto it = bit2const.find(bit);
+		return it == bit2const.end() ? State::Sx : it->second;
+	};
+	auto port_bit = [&](Cell *cell, IdString port) { return sigmap(cell->getPort(port))[0]; };
+
+	int num_const = 0;
+	int num_inv = 0;
+	int num_buf = 0;
+	int num_dangling = 0;
+	// sweep gates reading a bit and NOT output -> NOT input, both keyed by the sigmap representative
+	dict<SigBit, vector<Cell *>> gate_readers;
+	dict<SigBit, SigBit> not_input;
+	vector<Cell *> fold_work;
+	pool<Cell *> queued;
+	for (Cell *cell : module->cells()) {
+		if (!IsSweepGate(cell)) {
+			continue;
+		}
+		fold_work.push_back(cell);
+		queued.insert(cell);
+		for (auto &conn : cell->connections()) {
+			if (conn.first != ID(Y)) {
+				gate_readers[sigmap(conn.second)[0]].push_back(cell);
+			}
+		}
+		if (IsNOT(cell)) {
+			not_input[port_bit(cell, ID(Y))] = port_bit(cell, ID(A));
+		}
+	}
+	std::reverse(fold_work.begin(), fold_work.end());
+	pool<Cell *> removed;
+	while (!fold_work.empty()) {
+		Cell *cell = fold_work.back();
+		fold_work.pop_back();
+		queued.erase(cell);
+		SigBit y = port_bit(cell, ID(Y));
+		SigBit a = port_bit(cell, ID(A));
+		State ca = get_const(a);
+		State val = State::Sx;
+		SigBit alias;
+		bool has_alias = false;
+		int *counter = &num_const;
+		if (cell->type == ID($_BUF_)) {
+			alias = a, has_alias = true, counter = &num_buf;
+		} else if (IsNOT(cell)) {
+			if (ca != State::Sx) {
+				val = ca == State::S0 ? State::S1 : State::S0;
+			} else if (not_input.count(a)) {
+				alias = sigmap(not_input.at(a)), has_alias = true, counter = &num_inv;
+			}
+		} else if (IsMUX(cell)) {
+			SigBit b = port_bit(cell, ID(B));
+			State cs = get_const(port_bit(cell, ID(S)));
+			State cb = get_const(b);
+			if (cs == State::S0) {
+				alias = a, has_alias = true;
+			} else if (cs == State::S1) {
+				alias = b, has_alias = true;
+			} else if (a == b) {
+				alias = a, has_alias = true, counter = &num_buf;
+			} else if (ca != State::Sx && ca == cb) {
+				val = ca;
+			}
+		} else {
+			SigBit b = port_bit(cell, ID(B));
+			State cb = get_const(b);
+			if (IsAND(cell) || IsOR(cell)) {
+				// the controlling value forces the output, the other one passes the other input
+				State ctrl = IsAND(cell) ? State::S0 : State::S1;
+				if (ca == ctrl || cb == ctrl) {
+					val = ctrl;
+				} else if (ca != State::Sx && cb != State::Sx) {
+					val = ca;
+				} else if (ca != State::Sx) {
+					alias = b, has_alias = true;
+				} else if (cb != State::Sx) {
+					alias = a, has_alias = true;
+				} else if (a == b) {
+					alias = a, has_alias = true, counter = &num_buf;
+				}
+			} else if (IsXOR(cell)) {
+				if (ca != State::Sx && cb != State::Sx) {
+					val = ca == cb ? State::S0 : State::S1;
+				} else if (ca == State::S0) {
+					alias = b, has_alias = true;
+				} else if (cb == State::S0) {
+					alias = a, has_alias = true;
+				} else if (a == b) {
+					val = State::S0;
+				}
+			}
+		}
+		if (val != State::Sx) {
+			alias = const_src[val == State::S1];
+			has_alias = true;
+		}
+		if (!has_alias || sigmap(alias) == y) {
+			continue;
+		}
+		alias = sigmap(alias);
+		if (IsNOT(cell)) {
+			not_input.erase(y);
+		}
+		module->connect(cell->getPort(ID(Y)), alias);
+		sigmap.add(y, alias);
+		// the merged bit may get a new representative, move the entries of both old ones to it
+		SigBit rep = sigmap(y);
+		vector<Cell *> y_readers, readers;
+		if (gate_readers.count(y)) {
+			y_readers.swap(gate_readers.at(y));
+			gate_readers.erase(y);
+		}
+		if (gate_readers.count(alias)) {
+			readers.swap(gate_readers.at(alias));
+			gate_readers.erase(alias);
+		}
+		readers.insert(readers.end(), y_readers.begin(), y_readers.end());
+		gate_readers[rep].swap(readers);
+		for (SigBit old : {y, alias}) {
+			auto nit = not_input.find(old);
+			if (nit != not_input.end() && old != rep) {
+				SigBit input = nit->second;
+				not_input.erase(nit);
+				not_input[rep] = input;
+			}
+			auto cit = bit2const.find(old);
+			if (cit != bit2const.end() && old != rep) {
+				State c = cit->second;
+				bit2const.erase(cit);
+				bit2const[rep] = c;
+			}
+		}
+		if (val != State::Sx) {
+			bit2const[rep] = val;
+		}
+		module->remove(cell);
+		removed.insert(cell);
+		(*counter)++;
+		// only the readers of the folded output see a new input and can fold in turn
+		for (Cell *reader : y_readers) {
+			if (!removed.count(reader) && !queued.count(reader)) {
+				fold_work.push_back(reader);
+				queued.insert(reader);
+			}
+		}
+	}
+
+	// keep the gates on a path to a GTP cell or a module port
+	dict<SigBit, Cell *> gate_driver;
+	vector<SigBit> work;
+	for (Cell *cell : module->cells()) {
+		if (IsSweepGate(cell)) {
+			gate_driver[port_bit(cell, ID(Y))] = cell;
+			continue;
+		}
+		for (auto &conn : cell->connections()) {
+			for (auto bit : sigmap(conn.second)) {
+				work.push_back(bit);
+			}
+		}
+	}
+	for (Wire *wire : module->wires()) {
+		if (wire->port_output) {
+			for (auto bit : sigmap(SigSpec(wire))) {
+				work.push_back(bit);
+			}
+		}
+	}
+	pool<Cell *> used;
+	while (!work.empty()) {
+		SigBit bit = work.back();
+		work.pop_back();
+		auto it = gate_driver.find(bit);
+		if (it == gate_driver.end() || used.count(it->second)) {
+			continue;
+		}
+		used.insert(it->second);
+		for (auto &conn : it->second->connections()) {
+			if (conn.first != ID(Y)) {
+				work.push_back(sigmap(conn.second)[0]);
+			}
+		}
+	}
+	for (auto &it : gate_driver) {
+		if (!used.count(it.second)) {
+			module->remove(it.second);
+			num_dangling++;
+		}
+	}
+	sigmap.set(module);
+	log("sweep: %d constant gates, %d double inversions, %d buffers folded, %d dangling gates removed\n", num_const, num_inv, num_buf,
+	    num_dangling);
+}
+
+// AND/OR/XOR gate whose output only feeds one gate of the same type, it is folded into the reader's tree
+bool IsInternalTreeGate(Cell *cell, const pool<SigBit> &prime_outputs)
+{
+	SigBit out = GetCellOutput(cell);
+	if (prime_outputs.count(out) || !bit2reader.count(out) || bit2reader.at(out).size() != 1) {
+		return false;
+	}
+	Cell *reader = bit2reader.at(out)[0];
+	return reader->type == cell->type && cell2bits.at(reader).size() == 3;
+}
+
+// random simulation of the gates of a tree, 256 patterns per bit
+typedef std::array<uint64_t, 4> SimWords;
+SimWords SimulateTreeGate(Cell *cell, const dict<SigBit, SimWords> &values)
+{
+	const vector<SigBit> &bits = cell2bits.at(cell);
+	const SimWords &a = values.at(bits[1]);
+	const SimWords &b = values.at(bits[2]);
+	SimWords y;
+	for (int i = 0; i < 4; i++) {
+		y[i] = IsAND(cell) ? (a[i] & b[i]) : IsOR(cell) ? (a[i] | b[i]) : (a[i] ^ b[i]);
+	}
+	return y;
+}
+
+// Structural choices: every AND/OR/XOR tree deeper than needed gets a delay balanced copy next to it.
+// Equivalent nodes of the two versions are paired by random simulation and proven with SAT, and
+// GenerateCuts may then expand a leaf through either version. The copies are only read by each
+// other, so they never become prime outputs and ConeToLUTs drops the ones no LUT covers.
+void AddStructuralChoices(Module *module)
+{
+	vector<Cell *> gates;
+	GetTopoSortedGates(module, gates);
+	pool<SigBit> prime_inputs;
+	pool<SigBit> prime_outputs;
+	GetPrimeInputOuput(module, prime_inputs, prime_outputs);
+
+	dict<SigBit, int> level;
+	for (Cell *cell : gates) {
+		vector<SigBit> inputs;
+		GetCellInputsVector(cell, inputs);
+		int lvl = 0;
+		for (auto &bit : inputs) {
+			lvl = max(lvl, level.count(bit) ? level.at(bit) : 0);
+		}
+		level[GetCellOutput(cell)] = lvl + 1;
+	}
+
+	std::mt19937_64 rng(1);
+	int num_trees = 0;
+	int num_choices = 0;
+	int num_sat_fail = 0;
+	for (Cell *root : gates) {
+		if (!(IsAND(root) || IsOR(root) || IsXOR(root)) || cell2bits.at(root).size() != 3 || IsInternalTreeGate(root, prime_outputs)) {
+			continue;
+		}
+		// collect the tree below root
+		vector<Cell *> tree;
+		vector<SigBit> leaves;
+		vector<SigBit> stack = {GetCellOutput(root)};
+		while (!stack.empty()) {
+			SigBit bit = stack.back();
+			stack.pop_back();
+			Cell *drv = bit2driver.count(bit) ? bit2driver.at(bit) : nullptr;
+			if (drv && (drv == root || (drv->type == root->type && cell2bits.at(drv).size() == 3 && IsInternalTreeGate(drv, prime_outputs)))) {
+				tree.push_back(drv);
+				stack.push_back(cell2bits.at(drv)[1]);
+				stack.push_back(cell2bits.at(drv)[2]);
+			} else {
+				leaves.push_back(bit);
+			}
+		}
+		if (leaves.size() < 3) {
+			continue;
+		}
+
+		// Huffman style rebuild, always combine the two earliest arriving signals.
+		// The depth does not depend on tie breaking, so check it before adding anything.
+		priority_queue<int, vector<int>, std::greater<int>> depths;
+		for (auto &bit : leaves) {
+			depths.push(level.count(bit) ? level.at(bit) : 0);
+		}
+		while (depths.size() > 1) {
+			int a = depths.top();
+			depths.pop();
+			int b = depths.top();
+			depths.pop();
+			depths.push(max(a, b) + 1);
+		}
+		if (depths.top() >= level.at(GetCellOutput(root))) {
+			continue;
+		}
+		num_trees++;
+		IdString type = IsAND(root) ? ID($_AND_) : IsOR(root) ? ID($_OR_) : ID($_XOR_);
+		typedef pair<int, SigBit> Arrival;
+		priority_queue<Arrival, vector<Arrival>, std::greater<Arrival>> arrivals;
+		for (auto &bit : leaves) {
+			arrivals.push({level.count(bit) ? level.at(bit) : 0, bit});
+		}
+		vector<pair<SigBit, pair<SigBit, SigBit>>> plan; // output <- (a, b)
+		vector<Cell *> copies;
+		while (arrivals.size() > 1) {
+			Arrival a = arrivals.top();
+			arrivals.pop();
+			Arrival b = arrivals.top();
+			arrivals.pop();
+			SigBit y = module->addWire(NEW_ID);
+			Cell *cell = module->addCell(module->uniquify(root->name.str() + "_choice"), type);
+			cell->setPort(ID::A, a.second);
+			cell->setPort(ID::B, b.second);
+			cell->setPort(ID::Y, y);
+			copies.push_back(cell);
+			choice_gates.insert(cell);
+			plan.push_back({y, {a.second, b.second}});
+			arrivals.push({max(a.first, b.first) + 1, y});
+		}
+
+		// pair equivalent nodes of both versions by simulation, then prove them
+		dict<SigBit, SimWords> values;
+		for (auto &bit : leaves) {
+			SimWords w;
+			for (auto &x : w) {
+				x = rng();
+			}
+			values[bit] = w;
+		}
+		for (auto it = tree.rbegin(); it != tree.rend(); ++it) {
+			values[GetCellOutput(*it)] = SimulateTreeGate(*it, values);
+		}
+		std::map<SimWords, SigBit> sig2orig;
+		for (Cell *cell : tree) {
+			SigBit out = GetCellOutput(cell);
+			sig2orig[values.at(out)] = out;
+		}
+		ezSatPtr ez;
+		SatGen satgen(ez.get(), &sigmap);
+		for (Cell *cell : tree) {
+			satgen.importCell(cell);
+		}
+		for (Cell *cell : copies) {
+			satgen.importCell(cell);
+		}
+		for (size_t i = 0; i < copies.size(); i++) {
+			SigBit out = plan[i].first;
+			const SigBit &a = plan[i].second.first;
+			const SigBit &b = plan[i].second.second;
+			cell2bits[copies[i]] = {out, a, b};
+			values[out] = SimulateTreeGate(copies[i], values);
+			auto match = sig2orig.find(values.at(out));
+			if (match == sig2orig.end()) {
+				continue;
+			}
+			int diff = ez->XOR(satgen.importSigSpec(out)[0], satgen.importSigSpec(match->second)[0]);
+			ez->setSolverTimeout(1);
+			if (ez->solve(diff) || ez->getSolverTimoutStatus()) {
+				num_sat_fail++;
+				continue;
+			}
+			bit2choices[match->second].push_back(out);
+			bit2choices[out].push_back(match->second);
+			num_choices++;
+		}
+	}
+	log("choices: %d trees rebalanced, %d equivalent node pairs proven, %d rejected by SAT\n", num_trees, num_choices, num_sat_fail);
+}
+
+// Re-cover the critical part of best_bit2cut: the LUTs on a path of max_level (what the depth
+// DFS of score.cc reports) and the gates a few levels in front of them get a larger cut budget,
+// then a depth oriented forward pass reselects cuts in that window while every other covering
+// LUT keeps its cut. Repeats while max_level drops without raising the score.cc cost.
+// Each round only relabels the window and its transitive fanout and updates the cover through
+// leaf reference counts; a rejected round gets its window cuts and cover entries back.
+void ResynthesizeCriticalPaths(const vector<Cell *> &gates, const pool<SigBit> &prime_inputs, const pool<SigBit> &prime_outputs)
+{
+	const int window_depth = 2;
+	const size_t budget_scale = 4;
+	dict<SigBit, uint32_t> cover = best_bit2cut;
+	int max_level = 0;
+	int cost = GetCoverCost(gates, cover, max_level);
+
+	// label every gate once: covered outputs keep their cut, the others take the depth oriented best cut
+	ResetMappingState();
+	for (auto &p : bit2reader) {
+		bit2fanout_est[p.first] = p.second.size();
+	}
+	cur_interation = 0;
+	for (SigBit pi : prime_inputs) {
+		bit2depth[GetBitId(pi)] = 0.0;
+	}
+	dict<Cell *, int> gate2index;
+	dict<SigBit, uint32_t> labels;
+	for (size_t i = 0; i < gates.size(); i++) {
+		SigBit out = GetCellOutput(gates[i]);
+		gate2index[gates[i]] = i;
+		uint32_t &label = labels[out];
+		if (cover.count(out)) {
+			label = cover.at(out);
+		} else {
+			GetBestCut(gates[i], label);
+		}
+		UpdateCutDepthAf(label, gates[i], out);
+	}
+
+	// references of each bit from cover leaves and outputs, a covered bit is dropped at zero
+	dict<SigBit, int> refs;
+	for (SigBit po : prime_outputs) {
+		refs[po]++;
+	}
+	for (auto &p : cover) {
+		for (int id : handle2info[p.second].leaf_ids) {
+			refs[id2bit[id]]++;
+		}
+	}
+	// old cover entries of the current round, empty optional for bits that were not covered
+	dict<SigBit, std::optional<uint32_t>> cover_undo;
+	auto save_cover = [&](SigBit bit) {
+		if (!cover_undo.count(bit)) {
+			cover_undo[bit] = cover.count(bit) ? std::optional<uint32_t>(cover.at(bit)) : std::nullopt;
+		}
+	};
+	auto push_leaves = [&](uint32_t cut, vector<SigBit> &work) {
+		for (int id : handle2info[cut].leaf_ids) {
+			work.push_back(id2bit[id]);
+		}
+	};
+	auto add_refs = [&](uint32_t cut) {
+		vector<SigBit> work;
+		push_leaves(cut, work);
+		while (!work.empty()) {
+			SigBit bit = work.back();
+			work.pop_back();
+			if (refs[bit]++ > 0 || !labels.count(bit)) {
+				continue;
+			}
+			save_cover(bit);
+			cover[bit] = labels.at(bit);
+			push_leaves(cover.at(bit), work);
+		}
+	};
+	auto remove_refs = [&](uint32_t cut) {
+		vector<SigBit> work;
+		push_leaves(cut, work);
+		while (!work.empty()) {
+			SigBit bit = work.back();
+			work.pop_back();
+			if (--refs.at(bit) > 0 || !cover.count(bit)) {
+				continue;
+			}
+			save_cover(bit);
+			push_leaves(cover.at(bit), work);
+			cover.erase(bit);
+		}
+	};
+
+	for (int round = 0; round < 8; round++) {
+		// critical LUTs, walking back from the outputs at max_level
+		dict<SigBit, int> bit2level;
+		GetCoverLevels(gates, cover, bit2level);
+		pool<SigBit> critical;
+		for (auto it = gates.rbegin(); it != gates.rend(); ++it) {
+			SigBit out = GetCellOutput(*it);
+			if (!cover.count(out)) {
+				continue;
+			}
+			int level = bit2level.at(out);
+			if (level == max_level) {
+				critical.insert(out);
+			}
+			if (!critical.count(out)) {
+				continue;
+			}
+			for (int id : handle2info[cover.at(out)].leaf_ids) {
+				SigBit bit = id2bit[id];
+				if (cover.count(bit) && bit2level.at(bit) == level - 1) {
+					critical.insert(bit);
+				}
+			}
+		}
+
+		// window: the cones of the critical LUTs plus window_depth levels of fanin gates
+		pool<Cell *> window;
+		vector<SigBit> frontier;
+		for (auto &out : critical) {
+			Cell *cell = bit2driver.at(out);
+			for (Cell *c : cell2cuts.at(cell).at(cover.at(out))) {
+				window.insert(c);
+			}
+			for (int id : handle2info[cover.at(out)].leaf_ids) {
+				frontier.push_back(id2bit[id]);
+			}
+		}
+		for (int d = 0; d < window_depth; d++) {
+			vector<SigBit> next;
+			for (auto &bit : frontier) {
+				Cell *drv = bit2driver.count(bit) ? bit2driver.at(bit) : nullptr;
+				if (!drv || !IsCombinationalGate(drv) || window.count(drv)) {
+					continue;
+				}
+				window.insert(drv);
+				vector<SigBit> inputs;
+				GetCellInputsVector(drv, inputs);
+				next.insert(next.end(), inputs.begin(), inputs.end());
+			}
+			frontier.swap(next);
+		}
+
+		// larger cut budget inside the window only, in topological order so fanin cuts are regenerated
+		// first; the old cuts are kept for a rejected round
+		auto topo_index = [&](Cell *cell) { return gate2index.count(cell) ? gate2index.at(cell) : -1; };
+		vector<Cell *> window_order(window.begin(), window.end());
+		std::sort(window_order.begin(), window_order.end(), [&](Cell *a, Cell *b) { return topo_index(a) < topo_index(b); });
+		dict<Cell *, dict<uint32_t, pool<Cell *>>> saved_cuts;
+		dict<Cell *, CutArray> saved_arrays;
+		size_t saved_budget = MAX_CUT_SIZE_PRE_CELL;
+		MAX_CUT_SIZE_PRE_CELL *= budget_scale;
+		for (Cell *cell : window_order) {
+			saved_cuts[cell].swap(cell2cuts.at(cell)); // known cuts would stop the enumeration early
+			saved_arrays[cell] = cell2cutarray.at(cell);
+			GenerateCuts(cell);
+			PruneDominatedCuts(cell);
+			BuildCutArray(cell);
+		}
+		MAX_CUT_SIZE_PRE_CELL = saved_budget;
+
+		// the window and its transitive fanout are the only gates whose label can change
+		pool<Cell *> affected = window;
+		vector<Cell *> work(window.begin(), window.end());
+		while (!work.empty()) {
+			SigBit out = GetCellOutput(work.back());
+			work.pop_back();
+			if (!bit2reader.count(out)) {
+				continue;
+			}
+			for (Cell *reader : bit2reader.at(out)) {
+				if (gate2index.count(reader) && affected.insert(reader).second) {
+					work.push_back(reader);
+				}
+			}
+		}
+		vector<Cell *> relabel;
+		for (Cell *cell : affected) {
+			if (gate2index.count(cell)) {
+				relabel.push_back(cell);
+			}
+		}
+		std::sort(relabel.begin(), relabel.end(), [&](Cell *a, Cell *b) { return gate2index.at(a) < gate2index.at(b); });
+
+		// depth oriented reselection in the window, the rest of the cover is kept
+		for (Cell *cell : relabel) {
+			SigBit out = GetCellOutput(cell);
+			uint32_t &label = labels.at(out);
+			if (window.count(cell) || !cover.count(out)) {
+				GetBestCut(cell, label);
+			}
+			UpdateCutDepthAf(label, cell, out);
+		}
+		cover_undo.clear();
+		for (Cell *cell : relabel) {
+			SigBit out = GetCellOutput(cell);
+			if (!cover.count(out) || cover.at(out) == labels.at(out)) {
+				continue;
+			}
+			save_cover(out);
+			uint32_t old_cut = cover.at(out);
+			cover[out] = labels.at(out);
+			add_refs(cover.at(out));
+			remove_refs(old_cut);
+		}
+
+		int new_level = 0;
+		int new_cost = GetCoverCost(gates, cover, new_level);
+		log("critical round %d: %ld critical luts, window of %ld gates, %ld gates relabeled, max_level %d -> %d, cost %d -> %d\n", round,
+		    critical.size(), window.size(), relabel.size(), max_level, new_level, cost, new_cost);
+		if (new_level >= max_level || new_cost > cost) {
+			for (auto &it : cover_undo) {
+				if (it.second) {
+					cover[it.first] = *it.second;
+				} else {
+					cover.erase(it.first);
+				}
+			}
+			for (Cell *cell : window) {
+				cell2cuts.at(cell).swap(saved_cuts.at(cell));
+				cell2cutarray.at(cell) = std::move(saved_arrays.at(cell));
+			}
+			saved_cuts.clear();
+			ReleaseDeadCuts();
+			break;
+		}
+		// the replaced window cuts are only referenced by saved_cuts
+		saved_cuts.clear();
+		ReleaseDeadCuts();
+		max_level = new_level;
+		cost = new_cost;
+	}
+	ResetMappingState();
+	best_bit2cut = std::move(cover);
+}
+
+bool MapperMain(Module *module)
+{
+	if (remap_luts) {
+		// cuts start from a cell's own fanins, a LUT wider than -k can not be covered
+		for (Cell *cell : module->cells()) {
+			if (IsGTP_LUT(cell) > (int)LUT_SIZE) {
+				log_cmd_error("-remap with -k %d can not cover %s (%s), use -k %d or more.\n", LUT_SIZE, log_id(cell), log_id(cell->type),
+					      IsGTP_LUT(cell));
+			}
+		}
+	}
+	cut_kernels = GetCutKernels(LUT_SIZE);
+	SweepNetlist(module);
+	CheckCellWidth(module);
+	if (use_choices) {
+		AddStructuralChoices(module);
+		bit2driver.clear();
+		bit2reader.clear();
+		cell2bits.clear();
+		sigmap.set(module);
+		CheckCellWidth(module);
+	}
+	vector<Cell *> gates;
+	GetTopoSortedGates(module, gates);
+	ReorderGates(gates);
+	pool<SigBit> prime_inputs;
+	pool<SigBit> prime_outputs;
+	GetPrimeInputOuput(module, prime_inputs, prime_outputs);
+	log_debug("found %ld prime input and %ld prime output\n", prime_inputs.size(), prime_outputs.size());
+	CacheCounters cache_counters;
+	cache_counters.start();
+	auto start_time = std::chrono::high_resolution_clock::now();
+	if (PORTFOLIO_SIZE > 1) {
+		// the workers share the cut database, so it is built up front
+		GenerateCuts(module);
+		BuildCutArrays(gates);
+		RunPortfolio(gates, prime_inputs, prime_outputs);
+	} else {
+		cur_strategy = MapperStrategy();
+		cur_strategy.iterations = MAX_INTERATIONS;
+		RunMapping(gates, prime_inputs, prime_outputs);
+	}
+	auto duration = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+	const char *order_names[] = {"topo", "dfs", "rcm"};
+	log("mapping traversals took %.3f s with %s gate order\n", duration, order_names[GATE_ORDER]);
+	uint64_t cache_events[CacheCounters::NUM_EVENTS];
+	if (cache_counters.stop(cache_events)) {
+		log("mapping traversals: %llu cache references, %llu cache misses (%.2f%%) with %s gate order\n",
+		    (unsigned long long)cache_events[0], (unsigned long long)cache_events[1],
+		    cache_events[0] ? 100.0 * cache_events[1] / cache_events[0] : 0.0, order_names[GATE_ORDER]);
+	} else {
+		log("mapping traversals: cache counters are not available\n");
+	}
+	ReleaseDeadCuts();
+	LogCutTableStats();
+	if (critical_resynthesis) {
+		ResynthesizeCriticalPaths(gates, prime_inputs, prime_outputs);
+	}
+	vector<ExactNetwork> exact_networks;
+	if (exact_synthesis) {
+		PlanExactWindows(gates, best_bit2cut, exact_networks);
+	}
+	log_debug("Map cut to GTP_LUT\n");
+	ConeToLUTs(module, best_bit2cut);
+	InstantiateExactWindows(module, exact_networks);
+	return true;
+}
+
+// -----------------------
+bool MapperInit(Module *module)
+{
+	log_debug("Pango init\n");
+	SetPangoCellTypes(&yosys_celltypes);
+
+	ResetMappingState();
+	bit2driver.clear();
+	bit2reader.clear();
+	cell2bits.clear();
+	cell2cuts.clear();
+	bit2choices.clear();
+	choice_gates.clear();
+	cut_table.clear();
+	handle2info.clear();
+	free_handles.clear();
+	num_pruned_cuts = 0;
+	num_released_cuts = 0;
+	cell2cutarray.clear();
+	bit2id.clear();
+	id2bit.clear();
+	sigmap.set(module); //别名统一
+	return true;
+}
+
+/*
+specify port dirction of each cell for yosys_celltypes/modwalker to
+delcare the input and output pin name of gtp cell
+after that, using yosys_celltypes.cell_output(cell->type,portname) to get port direction
+*/
+void SetPangoCellTypes(CellTypes *ct)
+{
+	ct->setup_type(ID(GTP_ADC_E2),
+		       {ID(VA), ID(VAUX), ID(DCLK), ID(DADDR), ID(DEN), ID(SECEN), ID(DWE), ID(DI), ID(CONVST), ID(RST_N), ID(LOADSC_N)},
+		       {ID(DO), ID(DRDY), ID(OVER_TEMP), ID(LOGIC_DONE_A), ID(LOGIC_DONE_B), ID(ADC_CLK_OUT), ID(DMODIFIED), ID(ALARM)}, false);
+	ct->setup_type(ID(GTP_APM_E2), {ID(CIN),   ID(CPI),   ID(CXI),	ID(CXBI),  ID(X),	 ID(XB),	ID(Y),	      ID(Z),	   ID(MODEIN),
+					ID(MODEY), ID(MODEZ), ID(CLK),	ID(CEX1),  ID(CEX2),	 ID(CEX3),	ID(CEXB),     ID(CEY1),	   ID(CEY2),
+					ID(CEZ),   ID(CEM),   ID(CEP),	ID(CEPRE), ID(CEMODEIN), ID(CEMODEY),	ID(CEMODEZ),  ID(RSTX),	   ID(RSTXB),
+					ID(RSTY),  ID(RSTZ),  ID(RSTM), ID(RSTP),  ID(RSTPRE),	 ID(RSTMODEIN), ID(RSTMODEY), ID(RSTMODEZ)},
+		       {ID(COUT), ID(CPO), ID(CXO), ID(CXBO), ID(P)}, false);
+	ct->setup_type(ID(GTP_BUF), {ID(I)}, {ID(Z)}, false);
+	ct->setup_type(ID(GTP_CFGCLK), {ID(CLKIN), ID(CE_N)}, {}, false);
+	ct->setup_type(ID(GTP_CLKBUFCE), {ID(CE), ID(CLKIN)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFG), {ID(CLKIN)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFGCE), {ID(CLKIN), ID(CE)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFGMUX), {ID(CLKIN0), ID(CLKIN1), ID(SEL)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFGMUX_E1), {ID(CLKIN0), ID(CLKIN1), ID(SEL), ID(EN)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFGMUX_E2), {ID(CLKIN0), ID(CLKIN1), ID(DETECT_CLK0), ID(DETECT_CLK1), ID(SEL)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFM), {ID(CLKIN)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFMCE), {ID(CLKIN), ID(CE)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFR), {ID(CLKIN)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFX), {ID(CLKIN)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKBUFXCE), {ID(CLKIN), ID(CE)}, {ID(CLKOUT)}, false);
+	ct->setup_type(ID(GTP_CLKPD), {ID(RST), ID(CLK_SAMPLE), ID(CLK_CTRL), ID(CLK_PHY), ID(DONE)}, {ID(FLAG_PD), ID(LOCK)}, false);
+	ct->setup_type(ID(GTP_DDC_E2),
+		       {ID(RST), ID(RST_TRAINING_N), ID(CLKA), ID(CLKB), ID(DQSI), ID(DQSIB), ID(DELAY_STEP0), ID(DELAY_STEP1), ID(DELAY_STEP2),
+			ID(DELAY_STEP3), ID(DELAY_STEP4), ID(DQS_GATE_CTRL), ID(GATE_SEL), ID(CLK_GATE_CTRL), ID(CLKA_GATE)},
+		       {ID(WCLK), ID(WCLK_DELAY), ID(DQSI_DELAY), ID(DQSIB_DELAY), ID(DGTS), ID(IFIFO_WADDR), ID(IFIFO_RADDR), ID(READ_VALID),
+			ID(DQS_DRIFT), ID(DRIFT_DETECT_ERR), ID(DQS_DRIFT_STATUS), ID(DQS_SAMPLE)},
+		       false);
+	ct->setup_type(ID(GTP_DDC_E2_DFT),
+		       {ID(RST), ID(RST_TRAINING_N), ID(CLKA), ID(CLKB), ID(DQSI), ID(DQSIB), ID(DELAY_STEP0), ID(DELAY_STEP1), ID(DELAY_STEP2),
+			ID(DELAY_STEP3), ID(DELAY_STEP4), ID(DQS_GATE_CTRL), ID(GATE_SEL), ID(CLK_GATE_CTRL), ID(CLKA_GATE)},
+		       {ID(WCLK), ID(WCLK_DELAY), ID(DQSI_DELAY), ID(DQSIB_DELAY), ID(DGTS), ID(IFIFO_WADDR), ID(IFIFO_RADDR), ID(READ_VALID),
+			ID(DQS_DRIFT), ID(DRIFT_DETECT_ERR), ID(DQS_DRIFT_STATUS), ID(DQS_SAMPLE), ID(GATE_HIGHB), ID(GATE_HIGH_LATCHB)},
+		       false);
+	ct->setup_type(ID(GTP_DDC_E3),
+		       {ID(RST), ID(RST_TRAINING_N), ID(CLKA), ID(CLKB), ID(DQSI), ID(DQSIB), ID(DELAY_STEP0), ID(DELAY_STEP1), ID(DELAY_STEP2),
+			ID(DELAY_STEP3), ID(DELAY_STEP4), ID(DQS_GATE_CTRL), ID(GATE_SEL), ID(CLK_GATE_CTRL), ID(CLKA_GATE)},
+		       {ID(WCLK), ID(WCLK_DELAY), ID(DQSI_DELAY), ID(DQSIB_DELAY), ID(DGTS), ID(IFIFO_WADDR), ID(IFIFO_RADDR), ID(READ_VALID),
+			ID(DQS_DRIFT), ID(DRIFT_DETECT_ERR), ID(DQS_DRIFT_STATUS), ID(DQS_SAMPLE)},
+		       false);
+	ct->setup_type(ID(GTP_DFF), {ID(D), ID(CLK)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_C), {ID(D), ID(CLK), ID(C)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_CE), {ID(D), ID(CLK), ID(C), ID(CE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_E), {ID(D), ID(CLK), ID(CE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_P), {ID(D), ID(CLK), ID(P)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_PE), {ID(D), ID(CLK), ID(P), ID(CE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_R), {ID(D), ID(CLK), ID(R)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_RE), {ID(D), ID(CLK), ID(R), ID(CE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_S), {ID(D), ID(CLK), ID(S)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DFF_SE), {ID(D), ID(CLK), ID(S), ID(CE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DLATCH), {ID(D), ID(G)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DLATCH_C), {ID(D), ID(G), ID(C)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DLATCH_CE), {ID(D), ID(G), ID(C), ID(GE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DLATCH_E), {ID(D), ID(G), ID(GE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DLATCH_P), {ID(D), ID(G), ID(P)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DLATCH_PE), {ID(D), ID(G), ID(P), ID(GE)}, {ID(Q)}, false);
+	ct->setup_type(ID(GTP_DLL_E2), {ID(CLKIN), ID(SYS_CLK), ID(PWD), ID(RST), ID(UPDATE_N)}, {ID(DELAY_STEP), ID(DELAY_STEP1), ID(LOCK)}, false);
+	ct->setup_type(ID(GTP_DRM18K_E1),
+		       {ID(DIA), ID(DIB), ID(ADDRA), ID(ADDRA_HOLD), ID(ADDRB), ID(ADDRB_HOLD), ID(BWEA), ID(BWEB), ID(CLKA), ID(CLKB), ID(CEA),
+			ID(CEB), ID(WEA), ID(WEB), ID(ORCEA), ID(ORCEB), ID(RSTA), ID(RSTB)},
+		       {ID(DOA), ID(DOB)}, false);
+	ct->setup_type(ID(GTP_DRM36K_E1),
+		       {ID(CINA),  ID(CINB),  ID(DIA),	ID(DIB),  ID(ADDRA),	      ID(ADDRA_HOLD),	 ID(ADDRB), ID(ADDRB_HOLD), ID(CSA),
+			ID(CSB),   ID(BWEA),  ID(BWEB), ID(CLKA), ID(CLKB),	      ID(CEA),		 ID(CEB),   ID(WEA),	    ID(WEB),
+			ID(ORCEA), ID(ORCEB), ID(RSTA), ID(RSTB), ID(INJECT_SBITERR), ID(INJECT_DBITERR)},
+		       {ID(COUTA), ID(COUTB), ID(DOA), ID(DOB), ID(ECC_SBITERR), ID(ECC_DBITERR), ID(ECC_RDADDR), ID(ECC_PARITY)}, false);
+	ct->setup_type(ID(GTP_EFUSECODE), {}, {ID(EFUSE_CODE)}, false);
+	ct->setup_type(ID(GTP_FIFO18K_E1), {ID(DI), ID(WCLK), ID(RCLK), ID(WCE), ID(RCE), ID(ORCE), ID(RST)},
+		       {ID(ALMOST_EMPTY), ID(ALMOST_FULL), ID(EMPTY), ID(FULL), ID(DO)}, false);
+	ct->setup_type(ID(GTP_FIFO36K_E1), {ID(DI), ID(WCLK), ID(RCLK), ID(WCE), ID(RCE), ID(ORCE), ID(RST), ID(INJECT_SBITERR), ID(INJECT_DBITERR)},
+		       {ID(ALMOST_EMPTY), ID(ALMOST_FULL), ID(EMPTY), ID(FULL), ID(DO), ID(ECC_SBITERR), ID(ECC_DBITERR)}, false);
+	ct->setup_type(ID(GTP_GPLL), {ID(CLKIN1),      ID(CLKIN2),	ID(CLKFB),	 ID(CLKIN_SEL),	  ID(DPS_CLK),	   ID(DPS_EN),
+				      ID(DPS_DIR),     ID(CLKOUT0_SYN), ID(CLKOUT1_SYN), ID(CLKOUT2_SYN), ID(CLKOUT3_SYN), ID(CLKOUT4_SYN),
+				      ID(CLKOUT5_SYN), ID(CLKOUT6_SYN), ID(CLKOUTF_SYN), ID(PLL_PWD),	  ID(RST),	   ID(APB_CLK),
+				      ID(APB_RST_N),   ID(APB_ADDR),	ID(APB_SEL),	 ID(APB_EN),	  ID(APB_WRITE),   ID(APB_WDATA)},
+		       {ID(CLKOUT0), ID(CLKOUT0N), ID(CLKOUT1), ID(CLKOUT1N), ID(CLKOUT2), ID(CLKOUT2N), ID(CLKOUT3), ID(CLKOUT3N), ID(CLKOUT4),
+			ID(CLKOUT5), ID(CLKOUT6), ID(CLKOUTF), ID(CLKOUTFN), ID(LOCK), ID(DPS_DONE), ID(APB_RDATA), ID(APB_READY)},
+		       false);
+	ct->setup_type(ID(GTP_GRS), {ID(GRS_N)}, {}, false);
+	ct->setup_type(ID(GTP_HPIO_VREF), {ID(CODE_VREF0), ID(CODE_VREF1), ID(CODE_VREF2), ID(CODE_VREF3)}, {}, false);
+	ct->setup_type(ID(GTP_HSSTHP_BUFDS), {ID(COM_POWERDOWN), ID(PAD_REFCLKP), ID(PAD_REFCLKN)}, {ID(REFCLK_OUTP), ID(PMA_REFCLK_TO_FABRIC)},
+		       false);
+	ct->setup_type(ID(GTP_HSSTHP_HPLL),
+		       {ID(P_CFG_RST_HPLL),
+			ID(P_CFG_CLK_HPLL),
+			ID(P_CFG_PSEL_HPLL),
+			ID(P_CFG_ENABLE_HPLL),
+			ID(P_CFG_WRITE_HPLL),
+			ID(P_CFG_ADDR_HPLL),
+			ID(P_CFG_WDATA_HPLL),
+			ID(P_HPLL_POWERDOWN),
+			ID(P_HPLL_RST),
+			ID(P_HPLL_LOCKDET_RST),
+			ID(P_RES_CAL_RST),
+			ID(P_TX_SYNC),
+			ID(P_HPLL_DIV_SYNC),
+			ID(P_REFCLK_DIV_SYNC),
+			ID(P_HPLL_VCO_CALIB_EN),
+			ID(P_RESCAL_I_CODE_I),
+			ID(P_HPLL_DIV_CHANGE),
+			ID(P_HPLL_REFCLK_I),
+			ID(REFCLK_TO_TX_SYNC_I),
+			ID(REFCLK_TO_REFCLK_SYNC_I),
+			ID(REFCLK_TO_DIV_SYNC_I),
+			ID(ANA_TX_SYNC_I),
+			ID(ANA_HPLL_REFCLK_SYNC_I),
+			ID(ANA_HPLL_DIV_SYNC_I),
+			ID(P_PLL_REFCLK6_I),
+			ID(REFCLK0),
 			ID(REFCLK1),
 			ID(REFCLK0_FROM_UPPER_HSST),
 			ID(REFCLK1_FROM_UPPER_HSST),
@@ -2282,374 +3419,1391 @@ void SetPangoCellTypes(CellTypes *ct)
 	ct->setup_type(ID(GTP_ZEROHOLDDELAY), {ID(DI)}, {ID(DO)}, false);
 }
 
-// generate all cut rooted on cell output
-// save it to cell2cuts
-bool GenerateCuts(Cell *cell)
+int GetBitId(SigBit bit)
+{
+	auto it = bit2id.find(bit);
+	log_assert(it != bit2id.end());
+	return it->second;
+}
+
+// sorted and unique bit ids of the inputs of cell
+void GetFaninIds(Cell *cell, vector<int> &ids)
+{
+	ids.clear();
+	vector<SigBit> inputs;
+	GetCellInputsVector(cell, inputs);
+	for (auto &bit : inputs) {
+		ids.push_back(GetBitId(bit));
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+// return the handle of the cut with the given sorted leaf ids, adding it to the cut table on first sight.
+// The ids are written into a free slot first so the lookup can hash them, the slot is given back on a hit.
+uint32_t InternCutIds(const int *ids, size_t num)
+{
+	uint32_t handle;
+	if (free_handles.empty()) {
+		handle = handle2info.size();
+		handle2info.emplace_back();
+	} else {
+		handle = free_handles.back();
+		free_handles.pop_back();
+	}
+	CutInfo &info = handle2info[handle];
+	info.leaf_ids.assign(ids, ids + num);
+	auto ins = cut_table.insert(handle);
+	if (!ins.second) {
+		info.leaf_ids.clear();
+		free_handles.push_back(handle);
+		return *ins.first;
+	}
+	info.size = num;
+	info.signature = 0;
+	for (int id : info.leaf_ids) {
+		info.signature |= uint64_t(1) << (id % 64);
+	}
+	return handle;
+}
+
+// leaf bits of an interned cut, in bit id order
+vector<SigBit> GetCutLeaves(uint32_t handle)
+{
+	vector<SigBit> leaves;
+	for (int id : handle2info[handle].leaf_ids) {
+		leaves.push_back(id2bit[id]);
+	}
+	return leaves;
+}
+
+// cut of at most K leaves, kept as sorted bit ids
+template <int K> struct FixedCut {
+	int size = 0;
+	int leaves[K];
+};
+
+// replace leaf pos of cut by the sorted fanin ids, false when the result has more than K leaves
+template <int K> bool ExpandCut(const FixedCut<K> &cut, int pos, const vector<int> &fanins, FixedCut<K> &out)
+{
+	int n = cut.size;
+	int m = fanins.size();
+	int i = 0;
+	int j = 0;
+	out.size = 0;
+	while (i < n || j < m) {
+		if (i == pos) {
+			i++;
+			continue;
+		}
+		int id;
+		if (j >= m || (i < n && cut.leaves[i] < fanins[j])) {
+			id = cut.leaves[i++];
+		} else if (i >= n || fanins[j] < cut.leaves[i]) {
+			id = fanins[j++];
+		} else {
+			id = cut.leaves[i++];
+			j++;
+		}
+		if (out.size == K) {
+			return false;
+		}
+		out.leaves[out.size++] = id;
+	}
+	return true;
+}
+
+// generate all cut rooted on cell output
+// save it to cell2cuts
+template <int K> bool GenerateCutsK(Cell *cell)
+{
+	if (!IsCombinationalGate(cell)) {
+		return false;
+	}
+	dict<uint32_t, pool<Cell *>> &cuts = cell2cuts[cell];
+	vector<int> fanins;
+	GetFaninIds(cell, fanins);
+	if (fanins.size() > K) {
+		log_error("cell %s has %ld inputs, more than the LUT size %d\n", cell->name.c_str(), fanins.size(), K);
+	}
+	FixedCut<K> default_cut;
+	for (int id : fanins) {
+		default_cut.leaves[default_cut.size++] = id;
+	}
+	pool<Cell *> cone;
+	cone.insert(cell);
+	uint32_t default_handle = InternCutIds(default_cut.leaves, default_cut.size);
+	cuts[default_handle] = cone;
+	vector<pair<FixedCut<K>, uint32_t>> tmp_cuts;
+	tmp_cuts.push_back({default_cut, default_handle});
+	for (size_t i = 0; i < MAX_CUT_SIZE_PRE_CELL && i < tmp_cuts.size(); ++i) {
+		FixedCut<K> cut = tmp_cuts[i].first;
+		uint32_t handle = tmp_cuts[i].second;
+		for (int pos = 0; pos < cut.size; pos++) {
+			SigBit cur_bit = id2bit[cut.leaves[pos]];
+			// expand through the leaf's own driver and through every structural choice of it
+			vector<Cell *> drivers;
+			drivers.push_back(bit2driver.count(cur_bit) ? bit2driver[cur_bit] : nullptr);
+			if (bit2choices.count(cur_bit)) {
+				for (auto &alt : bit2choices.at(cur_bit)) {
+					drivers.push_back(bit2driver.at(alt));
+				}
+			}
+			for (Cell *drv : drivers) {
+				if (!drv || !IsCombinationalGate(drv)) {
+					continue;
+				}
+				GetFaninIds(drv, fanins);
+				FixedCut<K> ncut;
+				if (!ExpandCut<K>(cut, pos, fanins, ncut)) {
+					continue;
+				}
+				uint32_t nhandle = InternCutIds(ncut.leaves, ncut.size);
+				if (cuts.count(nhandle)) { //防止重复
+					continue;
+				}
+				tmp_cuts.push_back({ncut, nhandle}); //将新产生的割集加入待处理队列中
+				pool<Cell *> ncone = cuts[handle];
+				ncone.insert(drv);
+				cuts[nhandle] = ncone;
+			}
+		}
+	}
+	log_debug("cell %s has %ld cuts\n", cell->name.c_str(), tmp_cuts.size());
+	return true;
+}
+
+bool GenerateCuts(Cell *cell) { return cut_kernels.generate_cuts(cell); }
+
+// Drop every cut that has a strict subset among the cuts of the same node: the subset has
+// no larger depth and no larger area flow under any labeling, so it is never worse.
+// Cuts are visited by size and only checked against the smaller cuts kept so far, a subset of
+// a dropped cut is itself a kept subset. The signature rejects most pairs before std::includes.
+void PruneDominatedCuts(Cell *cell)
+{
+	dict<uint32_t, pool<Cell *>> &cuts = cell2cuts.at(cell);
+	vector<uint32_t> handles;
+	for (auto &cutpair : cuts) {
+		handles.push_back(cutpair.first);
+	}
+	std::sort(handles.begin(), handles.end(), [](uint32_t a, uint32_t b) { return handle2info[a].size < handle2info[b].size; });
+	vector<uint32_t> kept;
+	vector<uint32_t> dominated;
+	for (uint32_t h : handles) {
+		const CutInfo &info = handle2info[h];
+		bool is_dominated = false;
+		for (uint32_t o : kept) {
+			const CutInfo &other = handle2info[o];
+			if (other.size >= info.size) {
+				break;
+			}
+			if (other.signature & ~info.signature) {
+				continue;
+			}
+			if (std::includes(info.leaf_ids.begin(), info.leaf_ids.end(), other.leaf_ids.begin(), other.leaf_ids.end())) {
+				is_dominated = true;
+				break;
+			}
+		}
+		if (is_dominated) {
+			dominated.push_back(h);
+		} else {
+			kept.push_back(h);
+		}
+	}
+	for (uint32_t h : dominated) {
+		cuts.erase(h);
+	}
+	num_pruned_cuts += dominated.size();
+}
+
+bool GenerateCuts(Module *module)
+{
+	pool<Cell *> cells;
+	GetGates(module, cells); // generate cuts for all combinational gates
+	for (Cell *cell : cells) {
+		GenerateCuts(cell);
+		PruneDominatedCuts(cell);
+	}
+	return true;
+}
+
+// Give the handles of cuts no node refers to any more back to the table. Covers only use cuts of
+// cell2cuts, so this must not run while cuts are parked outside it (see ResynthesizeCriticalPaths).
+void ReleaseDeadCuts()
+{
+	vector<bool> live(handle2info.size(), false);
+	for (auto &it : cell2cuts) {
+		for (auto &cutpair : it.second) {
+			live[cutpair.first] = true;
+		}
+	}
+	for (uint32_t h = 0; h < handle2info.size(); h++) {
+		CutInfo &info = handle2info[h];
+		if (live[h] || info.size == 0) {
+			continue;
+		}
+		cut_table.erase(h);
+		info.size = 0;
+		vector<int>().swap(info.leaf_ids);
+		free_handles.push_back(h);
+		num_released_cuts++;
+	}
+}
+
+void LogCutTableStats()
+{
+	size_t num_refs = 0;
+	for (auto &it : cell2cuts) {
+		num_refs += it.second.size();
+	}
+	size_t num_live = cut_table.size();
+	// measured footprint of the table: the slots, the leaf ids they own and the hash index
+	size_t bytes_slots = handle2info.capacity() * sizeof(CutInfo) + free_handles.capacity() * sizeof(uint32_t);
+	size_t bytes_leaves = 0;
+	for (auto &info : handle2info) {
+		bytes_leaves += info.leaf_ids.capacity() * sizeof(int);
+	}
+	// an unordered_set node holds the handle, the next pointer and the cached hash
+	size_t bytes_index = cut_table.bucket_count() * sizeof(void *) + num_live * (sizeof(void *) + sizeof(size_t) + sizeof(uint32_t));
+	log("kept %ld node cuts (%ld dominated cuts pruned)\n", num_refs, num_pruned_cuts);
+	log("cut table: %ld node cuts share %ld leaf sets, dedup ratio %.2f, %ld handles released, %ld free\n", num_refs, num_live,
+	    num_live ? float(num_refs) / num_live : 0.0, num_released_cuts, free_handles.size());
+	log("cut table size: %.1f KiB (slots %.1f KiB, leaf ids %.1f KiB, hash index %.1f KiB)\n",
+	    (bytes_slots + bytes_leaves + bytes_index) / 1024.0, bytes_slots / 1024.0, bytes_leaves / 1024.0, bytes_index / 1024.0);
+}
+
+// flatten the cuts of cell into the leaf id blocks used by GetBestCut
+void BuildCutArray(Cell *cell)
+{
+	const dict<uint32_t, pool<Cell *>> &cuts = cell2cuts.at(cell);
+	CutArray &arr = cell2cutarray[cell];
+	arr.cuts.clear();
+	size_t num_blocks = (cuts.size() + CUT_LANES - 1) / CUT_LANES;
+	arr.leaves.assign(num_blocks * LUT_SIZE * CUT_LANES, 0);
+	for (auto &cutpair : cuts) {
+		size_t idx = arr.cuts.size();
+		size_t block = idx / CUT_LANES;
+		size_t lane = idx % CUT_LANES;
+		const CutInfo &info = handle2info[cutpair.first];
+		log_assert(info.size <= LUT_SIZE);
+		for (size_t k = 0; k < info.size; k++) {
+			arr.leaves[(block * LUT_SIZE + k) * CUT_LANES + lane] = info.leaf_ids[k];
+		}
+		arr.cuts.push_back(cutpair.first);
+	}
+}
+
+void BuildCutArrays(const vector<Cell *> &gates)
 {
-	if (!IsCombinationalGate(cell)) {
-		return false;
+	for (Cell *cell : gates) {
+		BuildCutArray(cell);
 	}
-	dict<pool<SigBit>, pool<Cell *>> &cuts = cell2cuts[cell];
-	pool<SigBit> default_cut;
-	GetCellInputsSet(cell, default_cut);
-	pool<Cell *> cone;
-	cone.insert(cell);
-	cuts[default_cut] = cone;
-	vector<pool<SigBit>> tmp_cuts;
-	tmp_cuts.push_back(default_cut);
-	for (size_t i = 0; i < MAX_CUT_SIZE_PRE_CELL && i < tmp_cuts.size(); ++i) {
-		pool<SigBit> cut = tmp_cuts[i];
-		if (cut.size() > LUT_SIZE) {
+}
+
+// max leaf depth and sum of leaf area flow of each cut, one block of CUT_LANES cuts at a time.
+// Leaves are reduced in slot order so both kernels give bit identical results.
+template <int K> void EvalCutsScalar(const int *leaves, size_t num_blocks, const float *depth, const float *af, float *cut_depth, float *cut_af)
+{
+	for (size_t b = 0; b < num_blocks; b++) {
+		const int *block = leaves + b * K * CUT_LANES;
+		for (size_t lane = 0; lane < CUT_LANES; lane++) {
+			float d = depth[block[lane]];
+			float a = af[block[lane]];
+			for (int k = 1; k < K; k++) {
+				int id = block[k * CUT_LANES + lane];
+				d = max(d, depth[id]);
+				a += af[id];
+			}
+			cut_depth[b * CUT_LANES + lane] = d;
+			cut_af[b * CUT_LANES + lane] = a;
+		}
+	}
+}
+
+#ifdef MAPPER_HAS_AVX2_KERNEL
+template <int K>
+__attribute__((target("avx2"))) void EvalCutsAVX2(const int *leaves, size_t num_blocks, const float *depth, const float *af, float *cut_depth,
+						   float *cut_af)
+{
+	static_assert(CUT_LANES == 8, "one AVX2 register holds 8 cuts");
+	for (size_t b = 0; b < num_blocks; b++) {
+		const int *block = leaves + b * K * CUT_LANES;
+		__m256i ids = _mm256_loadu_si256((const __m256i *)block);
+		__m256 d = _mm256_i32gather_ps(depth, ids, 4);
+		__m256 a = _mm256_i32gather_ps(af, ids, 4);
+		for (int k = 1; k < K; k++) {
+			ids = _mm256_loadu_si256((const __m256i *)(block + k * CUT_LANES));
+			d = _mm256_max_ps(d, _mm256_i32gather_ps(depth, ids, 4));
+			a = _mm256_add_ps(a, _mm256_i32gather_ps(af, ids, 4));
+		}
+		_mm256_storeu_ps(cut_depth + b * CUT_LANES, d);
+		_mm256_storeu_ps(cut_af + b * CUT_LANES, a);
+	}
+}
+#endif
+
+void EvalCuts(const CutArray &arr, float *cut_depth, float *cut_af)
+{
+	size_t num_blocks = arr.leaves.size() / (LUT_SIZE * CUT_LANES);
+	cut_kernels.eval_cuts(arr.leaves.data(), num_blocks, bit2depth.data(), bit2af.data(), cut_depth, cut_af);
+}
+
+bool GetBestCut(Cell *cell, uint32_t &cut_selected)
+{
+	// depth-oriented cut selection
+	const CutArray &arr = cell2cutarray.at(cell);
+	size_t num_cuts = arr.cuts.size();
+	log_assert(num_cuts > 0);
+	if (num_cuts == 1) {
+		cut_selected = arr.cuts[0];
+		return handle2info[cut_selected].size > 0;
+	}
+
+	thread_local vector<float> cut_depth;
+	thread_local vector<float> cut_af;
+	cut_depth.resize(arr.leaves.size() / LUT_SIZE);
+	cut_af.resize(arr.leaves.size() / LUT_SIZE);
+	EvalCuts(arr, cut_depth.data(), cut_af.data());
+
+	float depth_bound = 1e9;
+	if (cur_interation != 0) {
+		SigBit outbit = GetCellOutput(cell);
+		depth_bound = cell2OptDepth[cell] - bit2height[outbit];
+	}
+	float selected_depth = 1e9;
+	float selected_af = 1e9;
+	int selected = -1;
+	float min_af = 1e9;
+	int min_af_idx = 0;
+	for (size_t i = 0; i < num_cuts; i++) {
+		float cur_depth = cut_depth[i];
+		float cur_af = cut_af[i];
+
+		if (cur_af < min_af) {
+			min_af = cur_af;
+			min_af_idx = i;
+		}
+
+		if (0 == cur_interation) {
+			if (abs(cur_depth - selected_depth) < 0.01 && cur_af < selected_af) {
+				selected = i;
+				selected_depth = cur_depth;
+				selected_af = cur_af;
+			} else if (cur_depth < selected_depth) {
+				selected = i;
+				selected_depth = cur_depth;
+				selected_af = cur_af;
+			}
+		} else {
+			if (cur_depth > depth_bound) {
+				continue;
+			}
+			if (cur_af < selected_af) {
+				selected = i;
+				selected_depth = cur_depth;
+				selected_af = cur_af;
+			}
+		}
+	}
+
+	if (selected < 0) {
+		// choose noting
+		if (!cur_strategy.quiet)
+			log_warning("cell %s not selected any cut at interation %ld\n", cell->name.c_str(), cur_interation);
+		selected = min_af_idx;
+	}
+	cut_selected = arr.cuts[selected];
+	return handle2info[cut_selected].size > 0;
+}
+
+float GetEstimatedFanout(SigBit bit)
+{
+	float alpha = cur_strategy.fanout_alpha;
+	size_t fanout_est = bit2fanout_est[bit];
+	size_t fanout = bit2reader.count(bit) ? bit2reader.at(bit).size() : 0;
+	float est = (fanout_est + alpha * fanout) / (1 + alpha);
+	return est;
+}
+
+bool UpdateCutDepthAf(uint32_t cut_selected, Cell *cell, SigBit outbit)
+{
+	float depth = 0;
+	float af = 0;
+	for (int id : handle2info[cut_selected].leaf_ids) {
+		af += bit2af[id];
+		depth = max(depth, bit2depth[id]);
+	}
+
+	float fanout_est = GetEstimatedFanout(outbit);
+	int out_id = GetBitId(outbit);
+	bit2depth[out_id] = depth + 1;
+	bit2af[out_id] = af / fanout_est;
+
+	return true;
+}
+
+// With generate_cuts the cuts of each node are enumerated, pruned and flattened right before
+// the node is labeled, so iteration 0 touches every cut once while it is still in cache.
+bool TraverseFWD(const vector<Cell *> &gates, const pool<SigBit> &prime_inputs, dict<SigBit, uint32_t> &bit2cut, bool generate_cuts)
+{
+	for (SigBit pi : prime_inputs) {
+		int id = GetBitId(pi);
+		bit2depth[id] = 0.0;
+		bit2af[id] = 0.0;
+	}
+
+	for (size_t i = 0; i < gates.size(); i++) {
+		if (generate_cuts) {
+			GenerateCuts(gates[i]);
+			PruneDominatedCuts(gates[i]);
+			BuildCutArray(gates[i]);
+		}
+		uint32_t cut_selected;
+		if (!GetBestCut(gates[i], cut_selected)) {
+			log_error(" not selected cut %s\n", gates[i]->name.c_str());
+		}
+		SigBit outbit = GetCellOutput(gates[i]);
+		bit2cut[outbit] = cut_selected;
+		UpdateCutDepthAf(cut_selected, gates[i], outbit);
+	}
+	return true;
+}
+bool TraverseBWD(const vector<Cell *> &gates, const pool<SigBit> &prime_outputs, dict<SigBit, uint32_t> &bit2cut)
+{
+	dict<SigBit, uint32_t> map_result;
+	dict<SigBit, size_t> bit2fanout_bwd;
+	pool<Cell *> s_for_check;
+	for (SigBit po : prime_outputs) {
+		bit2height[po] = 0.0;
+		if (bit2driver.count(po)) {
+			Cell *drv_cell = bit2driver.at(po);
+			if (IsCombinationalGate(drv_cell)) {
+				s_for_check.insert(drv_cell);
+			}
+		}
+		bit2fanout_bwd[po] = 0;
+	}
+
+	for (auto it = gates.rbegin(); it != gates.rend(); ++it) {
+		Cell *cell = *it;
+		log_assert(IsCombinationalGate(cell));
+		SigBit outbit = GetCellOutput(cell);
+		if (!s_for_check.count(cell)) {
 			continue;
 		}
-		for (SigBit &cur_bit : cut) {
-			pool<SigBit> ncut = cut;
-			Cell *drv = bit2driver.count(cur_bit) ? bit2driver[cur_bit] : nullptr;
-			if (!drv || !IsCombinationalGate(drv)) {
+		float cone_h = bit2height[outbit];
+		uint32_t cut_selected = bit2cut.at(outbit);
+		if (!map_result.count(outbit)) {
+			map_result[outbit] = cut_selected;
+		} else {
+			log_error("found cycle at %s\n", log_signal(outbit));
+			continue;
+		}
+		const pool<Cell *> &cone = cell2cuts.at(cell).at(cut_selected);
+		for (Cell *cell : cone) {
+			SigBit tmpbit = GetCellOutput(cell);
+			bit2height[tmpbit] = max(bit2height[tmpbit], cone_h);
+		}
+		for (int id : handle2info[cut_selected].leaf_ids) {
+			SigBit bit = id2bit[id];
+			bit2fanout_bwd[bit]++;
+			bit2height[bit] = max(bit2height[bit], cone_h + 1);
+			if (bit2driver.count(bit)) {
+				Cell *drv_cell = bit2driver.at(bit);
+				if (IsCombinationalGate(drv_cell)) {
+					s_for_check.insert(drv_cell);
+				}
+			}
+		}
+	}
+
+	for (auto &pp : bit2fanout_est) {
+		SigBit bit = pp.first;
+		size_t fo = pp.second;
+		if (bit2fanout_bwd.count(bit)) {
+			bit2fanout_est[bit] = bit2fanout_bwd[bit];
+		} else {
+			bit2fanout_est[bit] = 0; // this bit is not in any cut, maybe is a internal bit
+		}
+		for (auto reader : bit2reader.at(bit)) {
+			bit2fanout_est[bit] += IsGTP(reader);
+		}
+	}
+	bit2cut = std::move(map_result);
+	return true;
+}
+// truth table over K variables, bit i is the value under the input assignment i
+template <int K> struct TruthTable {
+	static constexpr int WORDS = K > 6 ? 1 << (K - 6) : 1;
+	uint64_t w[WORDS];
+};
+
+template <int K> TruthTable<K> GetConstTruthTable(bool value)
+{
+	TruthTable<K> tt;
+	for (int i = 0; i < TruthTable<K>::WORDS; i++) {
+		tt.w[i] = value ? ~uint64_t(0) : 0;
+	}
+	return tt;
+}
+
+// truth table of the projection on variable var
+template <int K> TruthTable<K> GetVarTruthTable(int var)
+{
+	const uint64_t masks[6] = {0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+				   0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull};
+	TruthTable<K> tt;
+	for (int i = 0; i < TruthTable<K>::WORDS; i++) {
+		tt.w[i] = var < 6 ? masks[var] : (((i >> (var - 6)) & 1) ? ~uint64_t(0) : 0);
+	}
+	return tt;
+}
+
+// driver used to evaluate bit inside a cut: with structural choices the cone may hold
+// the gate of an equivalent bit instead of the bit's own driver
+Cell *GetEvalDriver(SigBit bit, const pool<Cell *> *cone)
+{
+	Cell *drv = bit2driver.count(bit) ? bit2driver.at(bit) : nullptr;
+	if (!cone || (drv && cone->count(drv)) || !bit2choices.count(bit)) {
+		return drv;
+	}
+	for (auto &alt : bit2choices.at(bit)) {
+		Cell *alt_drv = bit2driver.at(alt);
+		if (cone->count(alt_drv)) {
+			return alt_drv;
+		}
+	}
+	return drv;
+}
+
+// evaluate the truth table of out over the leaf tables in bit_tt, all minterms at once
+template <int K> TruthTable<K> EvalTruthTable(dict<SigBit, TruthTable<K>> &bit_tt, SigBit out, const pool<Cell *> *cone)
+{
+	constexpr int WORDS = TruthTable<K>::WORDS;
+	if (bit_tt.count(out)) {
+		return bit_tt.at(out);
+	}
+	if (!out.wire && (out.data == State::S0 || out.data == State::S1)) {
+		return GetConstTruthTable<K>(out.data == State::S1);
+	}
+	Cell *cell = GetEvalDriver(out, cone);
+	if (!cell || !IsCombinationalGate(cell)) {
+		log_error("Cannot evaluate %s \n", log_signal(out));
+	}
+
+	vector<SigBit> bits = cell2bits.at(cell);
+	TruthTable<K> res;
+	if (IsAND(cell) || IsOR(cell)) {
+		bool is_and = IsAND(cell);
+		res = GetConstTruthTable<K>(is_and);
+		for (size_t i = 1; i < bits.size(); i++) {
+			TruthTable<K> in = EvalTruthTable<K>(bit_tt, bits[i], cone);
+			for (int k = 0; k < WORDS; k++) {
+				res.w[k] = is_and ? (res.w[k] & in.w[k]) : (res.w[k] | in.w[k]);
+			}
+		}
+	} else if (IsNOT(cell)) {
+		TruthTable<K> in = EvalTruthTable<K>(bit_tt, bits[1], cone);
+		for (int k = 0; k < WORDS; k++) {
+			res.w[k] = ~in.w[k];
+		}
+	} else if (IsXOR(cell)) {
+		TruthTable<K> in0 = EvalTruthTable<K>(bit_tt, bits[1], cone);
+		TruthTable<K> in1 = EvalTruthTable<K>(bit_tt, bits[2], cone);
+		for (int k = 0; k < WORDS; k++) {
+			res.w[k] = in0.w[k] ^ in1.w[k];
+		}
+	} else if (IsMUX(cell)) {
+		TruthTable<K> sel = EvalTruthTable<K>(bit_tt, sigmap(cell->getPort(ID(S)))[0], cone);
+		TruthTable<K> in0 = EvalTruthTable<K>(bit_tt, sigmap(cell->getPort(ID(A)))[0], cone);
+		TruthTable<K> in1 = EvalTruthTable<K>(bit_tt, sigmap(cell->getPort(ID(B)))[0], cone);
+		for (int k = 0; k < WORDS; k++) {
+			res.w[k] = (sel.w[k] & in1.w[k]) | (~sel.w[k] & in0.w[k]);
+		}
+	} else if (IsGTP_LUT(cell)) {
+		// sum of the minterms set in INIT
+		int lut_size = IsGTP_LUT(cell);
+		const Const &init = cell->getParam(ID::INIT);
+		vector<TruthTable<K>> ins;
+		for (int i = 0; i < lut_size; i++) {
+			ins.push_back(EvalTruthTable<K>(bit_tt, sigmap(cell->getPort(IdString("\\I" + to_string(i))))[0], cone));
+		}
+		res = GetConstTruthTable<K>(false);
+		for (int index = 0; index < (1 << lut_size) && index < init.size(); index++) {
+			if (init.at(index) != State::S1) {
 				continue;
 			}
-			ncut.erase(cur_bit);
-			pool<SigBit> tinputs;
-			GetCellInputsSet(drv, tinputs);
-			ncut.insert(tinputs.begin(), tinputs.end());
+			TruthTable<K> term = GetConstTruthTable<K>(true);
+			for (int i = 0; i < lut_size; i++) {
+				for (int k = 0; k < WORDS; k++) {
+					term.w[k] &= ((index >> i) & 1) ? ins[i].w[k] : ~ins[i].w[k];
+				}
+			}
+			for (int k = 0; k < WORDS; k++) {
+				res.w[k] |= term.w[k];
+			}
+		}
+	} else {
+		log_error("unhandled cell %s \n", cell->type.c_str());
+	}
+	bit_tt[out] = res;
+	return res;
+}
+
+template <int K> vector<bool> GetCutInitK(const vector<SigBit> &cut, SigBit out, const pool<Cell *> *cone)
+{
+	log_assert(int(cut.size()) <= K && cut.size() >= 1);
+	dict<SigBit, TruthTable<K>> bit_tt;
+	for (size_t n = 0; n < cut.size(); n++) {
+		bit_tt[cut[n]] = GetVarTruthTable<K>(n);
+	}
+	TruthTable<K> tt = EvalTruthTable<K>(bit_tt, out, cone);
+	size_t bits_num = size_t(1) << cut.size();
+	vector<bool> cut_init(bits_num, false);
+	for (size_t i = 0; i < bits_num; i++) {
+		cut_init[i] = (tt.w[i >> 6] >> (i & 63)) & 1;
+	}
+	return cut_init;
+}
+
+vector<bool> GetCutInit(const vector<SigBit> &cut, SigBit out, const pool<Cell *> *cone)
+{
+	return cut_kernels.cut_init(cut, out, cone);
+}
+
+template <int K> CutKernels MakeCutKernels()
+{
+	CutKernels kernels;
+	kernels.generate_cuts = GenerateCutsK<K>;
+	kernels.eval_cuts = EvalCutsScalar<K>;
+#ifdef MAPPER_HAS_AVX2_KERNEL
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.eval_cuts = EvalCutsAVX2<K>;
+	}
+#endif
+	kernels.cut_init = GetCutInitK<K>;
+	return kernels;
+}
+
+CutKernels GetCutKernels(size_t lut_size)
+{
+	switch (lut_size) {
+	case 4:
+		return MakeCutKernels<4>();
+	case 5:
+		return MakeCutKernels<5>();
+	case 6:
+		return MakeCutKernels<6>();
+	case 7:
+		return MakeCutKernels<7>();
+	case 8:
+		return MakeCutKernels<8>();
+	default:
+		log_error("unsupported LUT size %ld, expect 4 to 8\n", lut_size);
+	}
+}
+
+// -----------------------
+// exact synthesis of small critical windows
+
+const int EXACT_MAX_INPUTS = 10;
+const int EXACT_MAX_BOTTOMS = 3;
+const size_t EXACT_MAX_WINDOWS = 64;
+
+
+// value of every LUT of net under input assignment m, returns the output
+bool EvalExactNetwork(const ExactNetwork &net, size_t m)
+{
+	int n = net.inputs.size();
+	vector<bool> values;
+	for (auto &lut : net.luts) {
+		size_t index = 0;
+		for (size_t i = 0; i < lut.inputs.size(); i++) {
+			int in = lut.inputs[i];
+			bool v = in < n ? (m >> in) & 1 : values[in - n];
+			index |= size_t(v) << i;
+		}
+		values.push_back(lut.init[index]);
+	}
+	return values.back();
+}
+
+// arrival level of the network output given the levels of the window inputs
+int GetExactArrival(const ExactNetwork &net, const vector<int> &input_levels)
+{
+	int n = net.inputs.size();
+	vector<int> arrival;
+	for (auto &lut : net.luts) {
+		int level = 0;
+		for (int in : lut.inputs) {
+			level = max(level, in < n ? input_levels[in] : arrival[in - n]);
+		}
+		arrival.push_back(level + 1);
+	}
+	return arrival.back();
+}
+
+// Depth 2 network with r bottom LUTs and one top LUT for func over n inputs, using the minisat
+// bundled with yosys. Bottom LUT j keeps a value per minterm plus input selection variables;
+// an unselected input must not change the value (flip invariance) and at most LUT_SIZE inputs
+// may be selected. Each of the LUT_SIZE top slots picks one window input or bottom output,
+// and the top truth table maps the slot values of every minterm to func.
+bool SolveExactDepth2(const vector<bool> &func, int n, int r, ExactNetwork &net, bool &budget_hit)
+{
+	const int K = LUT_SIZE;
+	const size_t M = size_t(1) << n;
+	Minisat::Solver solver;
+	vector<vector<Minisat::Var>> sel(r, vector<Minisat::Var>(n));
+	vector<vector<Minisat::Var>> bot(r, vector<Minisat::Var>(M));
+	vector<vector<Minisat::Var>> src(K, vector<Minisat::Var>(n + r));
+	vector<vector<Minisat::Var>> val(K, vector<Minisat::Var>(M));
+	vector<Minisat::Var> top(size_t(1) << K);
+	for (auto *vars : {&sel, &bot, &src, &val}) {
+		for (auto &row : *vars) {
+			for (auto &v : row) {
+				v = solver.newVar();
+			}
+		}
+	}
+	for (auto &v : top) {
+		v = solver.newVar();
+	}
+	Minisat::vec<Minisat::Lit> clause;
+	auto add_clause = [&](std::initializer_list<Minisat::Lit> lits) {
+		clause.clear();
+		for (auto lit : lits) {
+			clause.push(lit);
+		}
+		solver.addClause(clause);
+	};
 
-			if (ncut.size() > LUT_SIZE) {
+	for (int j = 0; j < r; j++) {
+		for (int i = 0; i < n; i++) {
+			for (size_t m = 0; m < M; m++) {
+				if ((m >> i) & 1) {
+					continue;
+				}
+				size_t m2 = m | (size_t(1) << i);
+				add_clause({Minisat::mkLit(sel[j][i]), ~Minisat::mkLit(bot[j][m]), Minisat::mkLit(bot[j][m2])});
+				add_clause({Minisat::mkLit(sel[j][i]), Minisat::mkLit(bot[j][m]), ~Minisat::mkLit(bot[j][m2])});
+			}
+		}
+		// at most K selected inputs: no K + 1 of them together
+		for (size_t mask = 0; mask < (size_t(1) << n); mask++) {
+			if (__builtin_popcountll(mask) != K + 1) {
 				continue;
 			}
-			if (cuts.count(ncut)) { //防止重复
-				continue;
+			clause.clear();
+			for (int i = 0; i < n; i++) {
+				if ((mask >> i) & 1) {
+					clause.push(~Minisat::mkLit(sel[j][i]));
+				}
+			}
+			solver.addClause(clause);
+		}
+	}
+	for (int t = 0; t < K; t++) {
+		clause.clear();
+		for (int k = 0; k < n + r; k++) {
+			clause.push(Minisat::mkLit(src[t][k]));
+		}
+		solver.addClause(clause);
+		for (int k = 0; k < n + r; k++) {
+			for (int k2 = k + 1; k2 < n + r; k2++) {
+				add_clause({~Minisat::mkLit(src[t][k]), ~Minisat::mkLit(src[t][k2])});
+			}
+		}
+		for (size_t m = 0; m < M; m++) {
+			for (int k = 0; k < n; k++) {
+				add_clause({~Minisat::mkLit(src[t][k]), Minisat::mkLit(val[t][m], !((m >> k) & 1))});
+			}
+			for (int j = 0; j < r; j++) {
+				add_clause({~Minisat::mkLit(src[t][n + j]), ~Minisat::mkLit(bot[j][m]), Minisat::mkLit(val[t][m])});
+				add_clause({~Minisat::mkLit(src[t][n + j]), Minisat::mkLit(bot[j][m]), ~Minisat::mkLit(val[t][m])});
+			}
+		}
+	}
+	for (size_t m = 0; m < M; m++) {
+		for (size_t p = 0; p < top.size(); p++) {
+			clause.clear();
+			for (int t = 0; t < K; t++) {
+				clause.push(Minisat::mkLit(val[t][m], (p >> t) & 1));
+			}
+			clause.push(Minisat::mkLit(top[p], !func[m]));
+			solver.addClause(clause);
+		}
+	}
+
+	solver.setConfBudget(EXACT_CONFLICT_BUDGET);
+	Minisat::vec<Minisat::Lit> assumps;
+	Minisat::lbool ret = solver.solveLimited(assumps);
+	if (ret == l_Undef) {
+		budget_hit = true;
+	}
+	if (ret != l_True) {
+		return false;
+	}
+
+	// read back the network, bottoms the top does not read are dropped
+	net.luts.clear();
+	vector<int> top_srcs;
+	vector<int> slot_pos(K);
+	for (int t = 0; t < K; t++) {
+		int k = 0;
+		while (solver.modelValue(src[t][k]) != l_True) {
+			k++;
+		}
+		auto it = std::find(top_srcs.begin(), top_srcs.end(), k);
+		slot_pos[t] = it - top_srcs.begin();
+		if (it == top_srcs.end()) {
+			top_srcs.push_back(k);
+		}
+	}
+	// position of each source among the top LUT inputs, -1 for a constant bottom
+	ExactLut top_lut;
+	vector<int> src_pos(top_srcs.size(), -1);
+	vector<bool> src_const(top_srcs.size(), false);
+	for (size_t s = 0; s < top_srcs.size(); s++) {
+		int k = top_srcs[s];
+		if (k < n) {
+			src_pos[s] = top_lut.inputs.size();
+			top_lut.inputs.push_back(k);
+			continue;
+		}
+		int j = k - n;
+		ExactLut lut;
+		for (int i = 0; i < n; i++) {
+			if (solver.modelValue(sel[j][i]) == l_True) {
+				lut.inputs.push_back(i);
+			}
+		}
+		if (lut.inputs.empty()) {
+			// a constant bottom is not worth a LUT, its value goes into the top truth table
+			src_const[s] = solver.modelValue(bot[j][0]) == l_True;
+			continue;
+		}
+		for (size_t q = 0; q < (size_t(1) << lut.inputs.size()); q++) {
+			size_t m = 0;
+			for (size_t i = 0; i < lut.inputs.size(); i++) {
+				m |= ((q >> i) & 1) << lut.inputs[i];
 			}
-			cuts.insert(ncut);
-			tmp_cuts.push_back(ncut); //将新产生的割集加入待处理队列中
-			pool<Cell *> ncone = cuts[cut];
-			ncone.insert(drv);
-			cuts[ncut] = ncone;
+			lut.init.push_back(solver.modelValue(bot[j][m]) == l_True);
 		}
+		net.luts.push_back(lut);
+		src_pos[s] = top_lut.inputs.size();
+		top_lut.inputs.push_back(n + net.luts.size() - 1);
 	}
-	log_debug("cell %s has %ld cuts\n", cell->name.c_str(), tmp_cuts.size());
-	return true;
-}
-
-bool GenerateCuts(Module *module)
-{
-	pool<Cell *> cells;
-	GetGates(module, cells); // generate cuts for all combinational gates
-	for (Cell *cell : cells) {
-		GenerateCuts(cell);
+	if (top_lut.inputs.empty()) {
+		return false; // a constant function, GTP_LUT needs at least one input
+	}
+	for (size_t q = 0; q < (size_t(1) << top_lut.inputs.size()); q++) {
+		size_t p = 0;
+		for (int t = 0; t < K; t++) {
+			int s = slot_pos[t];
+			size_t v = src_pos[s] < 0 ? size_t(src_const[s]) : (q >> src_pos[s]) & 1;
+			p |= v << t;
+		}
+		top_lut.init.push_back(solver.modelValue(top[p]) == l_True);
+	}
+	net.luts.push_back(top_lut);
+	for (size_t m = 0; m < M; m++) {
+		if (EvalExactNetwork(net, m) != func[m]) {
+			log_error("exact synthesis produced a wrong network for %s\n", log_signal(net.out));
+		}
 	}
 	return true;
 }
 
-bool GetBestCut(Cell *cell, pool<SigBit> &cut_selected)
+// Look for better LUT networks of the windows ending in the deepest covered outputs: a window
+// grows from the output's cut by absorbing the cuts of its deepest covered leaves while it has
+// at most EXACT_MAX_INPUTS inputs. Windows with at most LUT_SIZE inputs become one LUT, larger
+// ones get the depth 2 network with the fewest bottom LUTs. The networks are kept only when the
+// estimated score.cc cost of the cover drops, InstantiateExactWindows builds them after ConeToLUTs.
+void PlanExactWindows(const vector<Cell *> &gates, const dict<SigBit, uint32_t> &cover, vector<ExactNetwork> &networks)
 {
-	cut_selected.clear();
-	// depth-oriented cut selection
-	const dict<pool<SigBit>, pool<Cell *>> &cuts = cell2cuts[cell];
-	if (cuts.size() == 1) {
-		cut_selected = cuts.begin()->first;
-		return cut_selected.size() > 0;
+	networks.clear();
+	if (using_internel_lut_type) {
+		log_warning("exact synthesis is skipped when mapping to $lut cells\n");
+		return;
+	}
+	dict<SigBit, int> bit2level;
+	GetCoverLevels(gates, cover, bit2level);
+	auto level_of = [&](SigBit bit) { return bit2level.count(bit) ? bit2level.at(bit) : 0; };
+	int max_level = 0;
+	for (auto &p : bit2level) {
+		max_level = max(max_level, p.second);
 	}
-	float selected_depth = 1e9;
-	float selected_af = 1e9;
-	log_assert(cuts.size() > 0);
 
-	float min_af = 1e9;
-	pool<SigBit> min_af_cut;
-	for (auto cutpair : cuts) {
-		pool<SigBit> cur_cut = cutpair.first;
-		float cur_depth = -1e9;
-		float cur_af = 0;
-		for (auto &bit : cur_cut) {
-			cur_depth = max(bit2depth[bit], cur_depth);
-			cur_af += bit2af[bit];
+	int num_tried = 0;
+	int num_budget_hit = 0;
+	for (Cell *cell : gates) {
+		SigBit out = GetCellOutput(cell);
+		if (!cover.count(out) || level_of(out) != max_level || networks.size() >= EXACT_MAX_WINDOWS) {
+			continue;
+		}
+		ExactNetwork net;
+		net.out = out;
+		vector<SigBit> out_leaves = GetCutLeaves(cover.at(out));
+		pool<SigBit> inputs(out_leaves.begin(), out_leaves.end());
+		pool<SigBit> tried;
+		while (true) {
+			SigBit leaf;
+			bool found = false;
+			for (auto &bit : inputs) {
+				if (cover.count(bit) && !tried.count(bit) && (!found || level_of(bit) > level_of(leaf))) {
+					leaf = bit;
+					found = true;
+				}
+			}
+			if (!found) {
+				break;
+			}
+			tried.insert(leaf);
+			pool<SigBit> grown = inputs;
+			grown.erase(leaf);
+			for (auto &bit : GetCutLeaves(cover.at(leaf))) {
+				grown.insert(bit);
+			}
+			if (int(grown.size()) <= EXACT_MAX_INPUTS) {
+				inputs = grown;
+				net.window_outs.insert(leaf);
+			}
+		}
+		if (net.window_outs.empty()) {
+			continue;
+		}
+		net.inputs = vector<SigBit>(inputs.begin(), inputs.end());
+		int n = net.inputs.size();
+		vector<int> input_levels;
+		int max_in = 0;
+		for (auto &bit : net.inputs) {
+			input_levels.push_back(level_of(bit));
+			max_in = max(max_in, level_of(bit));
+		}
+		int old_arrival = level_of(out);
+		if (max_in + (n <= int(LUT_SIZE) ? 1 : 2) >= old_arrival) {
+			continue;
 		}
 
-		if (cur_af < min_af) {
-			min_af = cur_af;
-			min_af_cut = cur_cut;
+		// function of the window over its inputs
+		pool<Cell *> cone;
+		pool<SigBit> outs = net.window_outs;
+		outs.insert(out);
+		for (auto &bit : outs) {
+			for (Cell *c : cell2cuts.at(bit2driver.at(bit)).at(cover.at(bit))) {
+				cone.insert(c);
+			}
+		}
+		dict<SigBit, TruthTable<EXACT_MAX_INPUTS>> bit_tt;
+		for (int i = 0; i < n; i++) {
+			bit_tt[net.inputs[i]] = GetVarTruthTable<EXACT_MAX_INPUTS>(i);
+		}
+		TruthTable<EXACT_MAX_INPUTS> tt = EvalTruthTable<EXACT_MAX_INPUTS>(bit_tt, out, &cone);
+		vector<bool> func(size_t(1) << n);
+		for (size_t m = 0; m < func.size(); m++) {
+			func[m] = (tt.w[m >> 6] >> (m & 63)) & 1;
 		}
 
-		if (0 == cur_interation) {
-			if (abs(cur_depth - selected_depth) < 0.01 && cur_af < selected_af) {
-				cut_selected = cur_cut;
-				selected_depth = cur_depth;
-				selected_af = cur_af;
-			} else if (cur_depth < selected_depth) {
-				cut_selected = cur_cut;
-				selected_depth = cur_depth;
-				selected_af = cur_af;
+		num_tried++;
+		bool solved = false;
+		if (n <= int(LUT_SIZE)) {
+			ExactLut lut;
+			for (int i = 0; i < n; i++) {
+				lut.inputs.push_back(i);
 			}
+			lut.init = func;
+			net.luts.push_back(lut);
+			solved = true;
 		} else {
-			SigBit outbit = GetCellOutput(cell);
-			if (cur_depth > cell2OptDepth[cell] - bit2height[outbit]) {
-				continue;
-			}
-			if (cur_af < selected_af) {
-				cut_selected = cur_cut;
-				selected_depth = cur_depth;
-				selected_af = cur_af;
+			for (int r = 1; r <= EXACT_MAX_BOTTOMS && !solved; r++) {
+				bool budget_hit = false;
+				solved = SolveExactDepth2(func, n, r, net, budget_hit);
+				num_budget_hit += budget_hit;
 			}
 		}
+		if (solved && GetExactArrival(net, input_levels) < old_arrival) {
+			networks.push_back(net);
+		}
 	}
 
-	if (cut_selected.size() == 0) {
-		// choose noting
-		log_warning("cell %s not selected any cut at interation %ld\n", cell->name.c_str(), cur_interation);
-		cut_selected = min_af_cut;
+	// estimated cost with the networks, the LUTs they make redundant are still counted
+	dict<SigBit, const ExactNetwork *> out2net;
+	for (auto &net : networks) {
+		out2net[net.out] = &net;
+	}
+	dict<SigBit, int> new_levels;
+	int num_of_luts = cover.size();
+	int num_of_pins = 0;
+	int new_max_level = 0;
+	for (Cell *cell : gates) {
+		SigBit out = GetCellOutput(cell);
+		if (!cover.count(out)) {
+			continue;
+		}
+		int level = 0;
+		if (out2net.count(out)) {
+			const ExactNetwork *net = out2net.at(out);
+			vector<int> input_levels;
+			for (auto &bit : net->inputs) {
+				input_levels.push_back(new_levels.count(bit) ? new_levels.at(bit) : 0);
+			}
+			level = GetExactArrival(*net, input_levels);
+			num_of_luts += net->luts.size() - 1;
+			for (auto &lut : net->luts) {
+				num_of_pins += lut.inputs.size();
+			}
+		} else {
+			for (auto &bit : GetCutLeaves(cover.at(out))) {
+				level = max(level, new_levels.count(bit) ? new_levels.at(bit) : 0);
+			}
+			level += 1;
+			num_of_pins += handle2info[cover.at(out)].size;
+		}
+		new_levels[out] = level;
+		new_max_level = max(new_max_level, level);
+	}
+	int old_level = 0;
+	int old_cost = GetCoverCost(gates, cover, old_level);
+	int new_cost = (new_max_level / 20.0 + 1) * num_of_luts * 10 + num_of_pins;
+	log("exact synthesis: %d windows tried, %ld improved (%d hit the conflict budget), max_level %d -> %d, estimated cost %d -> %d\n",
+	    num_tried, networks.size(), num_budget_hit, old_level, new_max_level, old_cost, new_cost);
+	if (new_cost >= old_cost) {
+		networks.clear();
 	}
-	return cut_selected.size() > 0;
 }
 
-float GetEstimatedFanout(SigBit bit)
+// replace the LUTs driving the window outputs by the planned networks and drop the
+// window LUTs that are no longer read
+void InstantiateExactWindows(Module *module, const vector<ExactNetwork> &networks)
 {
-	float alpha = 2.5;
-	size_t fanout_est = bit2fanout_est[bit];
-	size_t fanout = bit2reader[bit].size();
-	float est = (fanout_est + alpha * fanout) / (1 + alpha);
-	return est;
-}
+	if (networks.empty()) {
+		return;
+	}
+	dict<SigBit, Cell *> lut_driver;
+	for (Cell *cell : module->cells()) {
+		if (IsGTP_LUT(cell)) {
+			lut_driver[sigmap(cell->getPort(ID(Z)))[0]] = cell;
+		}
+	}
+	pool<SigBit> candidates;
+	for (auto &net : networks) {
+		Cell *old = lut_driver.at(net.out);
+		IdString name = old->name;
+		lut_driver.erase(net.out);
+		module->remove(old);
+		int n = net.inputs.size();
+		vector<SigBit> lut_outs;
+		for (size_t i = 0; i < net.luts.size(); i++) {
+			const ExactLut &lut = net.luts[i];
+			SigBit z = i + 1 == net.luts.size() ? net.out : SigBit(module->addWire(NEW_ID));
+			Cell *cell = module->addCell(module->uniquify(name.str() + "_exact"), GetLutType(lut.inputs.size()));
+			cell->parameters[ID::INIT] = RTLIL::Const(lut.init);
+			for (size_t k = 0; k < lut.inputs.size(); k++) {
+				int in = lut.inputs[k];
+				cell->setPort(RTLIL::IdString("\\I" + to_string(k)), in < n ? net.inputs[in] : lut_outs[in - n]);
+			}
+			cell->setPort(ID(Z), z);
+			lut_outs.push_back(z);
+		}
+		candidates.insert(net.window_outs.begin(), net.window_outs.end());
+	}
 
-bool UpdateCutDepthAf(const pool<SigBit> &cut_selected, Cell *cell, SigBit outbit)
-{
-	float depth = 0;
-	float af = 0;
-	for (auto &bit : cut_selected) {
-		af += bit2af[bit];
-		depth = max(depth, bit2depth[bit]);
+	int num_removed = 0;
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		pool<SigBit> used;
+		for (Cell *cell : module->cells()) {
+			for (auto &conn : cell->connections()) {
+				if (!yosys_celltypes.cell_output(cell->type, conn.first)) {
+					for (auto bit : sigmap(conn.second)) {
+						used.insert(bit);
+					}
+				}
+			}
+		}
+		for (auto &bit : candidates) {
+			if (!lut_driver.count(bit) || used.count(bit) || (bit.wire && bit.wire->port_output)) {
+				continue;
+			}
+			module->remove(lut_driver.at(bit));
+			lut_driver.erase(bit);
+			num_removed++;
+			changed = true;
+		}
 	}
+	log("exact synthesis: %ld windows rebuilt, %d redundant LUTs removed\n", networks.size(), num_removed);
+}
 
-	float fanout_est = GetEstimatedFanout(outbit);
-	bit2depth[outbit] = depth + 1;
-	bit2af[outbit] = af / fanout_est;
+// -----------------------
+// sharded mapping: the combinational regions between registers and ports are split into
+// shard files, each one a module whose ports are the region boundary. Every shard is mapped
+// by its own process with mapper -shard and written back with mapper -import-shards.
 
-	return true;
-}
+const char *SHARD_MANIFEST = "manifest.txt";
 
-bool TraverseFWD(Module *module, const pool<SigBit> &prime_inputs, dict<SigBit, pool<SigBit>> &bit2cut)
+int FindShardRoot(vector<int> &parent, int x)
 {
-	for (SigBit pi : prime_inputs) {
-		bit2depth[pi] = 0.0;
-		bit2af[pi] = 0.0;
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]];
+		x = parent[x];
 	}
+	return x;
+}
 
+// read-only on the design: the sweep runs inside each shard when it is mapped, so the
+// manifest refers to the nets and gates of the design as it is
+void ExportShards(Module *module, const string &dir, int num_shards)
+{
+	CheckCellWidth(module);
 	vector<Cell *> gates;
 	GetTopoSortedGates(module, gates);
+
+	// regions are the connected components of gate to gate edges
+	dict<Cell *, int> gate2index;
 	for (size_t i = 0; i < gates.size(); i++) {
-		pool<SigBit> cut_selected;
-		if (!GetBestCut(gates[i], cut_selected)) {
-			log_error(" not selected cut %s\n", gates[i]->name.c_str());
-		}
-		SigBit outbit = GetCellOutput(gates[i]);
-		bit2cut[outbit] = cut_selected;
-		UpdateCutDepthAf(cut_selected, gates[i], outbit);
+		gate2index[gates[i]] = i;
 	}
-	return true;
-}
-bool TraverseBWD(Module *module, const pool<SigBit> &prime_outputs, dict<SigBit, pool<SigBit>> &bit2cut)
-{
-	dict<SigBit, pool<SigBit>> map_result;
-	dict<SigBit, size_t> bit2fanout_bwd;
-	pool<Cell *> s_for_check;
-	for (SigBit po : prime_outputs) {
-		bit2height[po] = 0.0;
-		if (bit2driver.count(po)) {
-			Cell *drv_cell = bit2driver[po];
-			if (IsCombinationalGate(drv_cell)) {
-				s_for_check.insert(drv_cell);
+	vector<int> parent(gates.size());
+	for (size_t i = 0; i < gates.size(); i++) {
+		parent[i] = i;
+	}
+	for (size_t i = 0; i < gates.size(); i++) {
+		vector<SigBit> inputs;
+		GetCellInputsVector(gates[i], inputs);
+		for (auto &bit : inputs) {
+			if (bit2driver.count(bit) && gate2index.count(bit2driver.at(bit))) {
+				parent[FindShardRoot(parent, i)] = FindShardRoot(parent, gate2index.at(bit2driver.at(bit)));
 			}
 		}
-		bit2fanout_bwd[po] = 0;
 	}
+	dict<int, vector<Cell *>> regions;
+	for (size_t i = 0; i < gates.size(); i++) {
+		regions[FindShardRoot(parent, i)].push_back(gates[i]);
+	}
+	vector<vector<Cell *> *> sorted_regions;
+	for (auto &it : regions) {
+		sorted_regions.push_back(&it.second);
+	}
+	std::stable_sort(sorted_regions.begin(), sorted_regions.end(),
+			 [](const vector<Cell *> *a, const vector<Cell *> *b) { return a->size() > b->size(); });
 
-	vector<Cell *> gates;
-	GetTopoSortedGates(module, gates);
-
-	for (auto it = gates.rbegin(); it != gates.rend(); ++it) {
-		Cell *cell = *it;
-		log_assert(IsCombinationalGate(cell));
-		SigBit outbit = GetCellOutput(cell);
-		if (!s_for_check.count(cell)) {
-			continue;
-		}
-		float cone_h = bit2height[outbit];
-		pool<SigBit> cut_selected = bit2cut[outbit];
-		if (!map_result.count(outbit)) {
-			map_result[outbit] = cut_selected;
-		} else {
-			log_error("found cycle at %s\n", log_signal(outbit));
-			continue;
+	// largest region first into the lightest shard
+	vector<vector<Cell *>> shards(num_shards);
+	dict<Cell *, int> gate2shard;
+	for (auto *region : sorted_regions) {
+		size_t lightest = 0;
+		for (size_t s = 1; s < shards.size(); s++) {
+			if (shards[s].size() < shards[lightest].size()) {
+				lightest = s;
+			}
 		}
-		pool<Cell *> cone = cell2cuts[cell][cut_selected];
-		for (Cell *cell : cone) {
-			SigBit tmpbit = GetCellOutput(cell);
-			bit2height[tmpbit] = max(bit2height[tmpbit], cone_h);
+		for (Cell *gate : *region) {
+			shards[lightest].push_back(gate);
+			gate2shard[gate] = lightest;
 		}
-		for (auto &bit : cut_selected) {
-			bit2fanout_bwd[bit]++;
-			bit2height[bit] = max(bit2height[bit], cone_h + 1);
-			if (bit2driver.count(bit)) {
-				Cell *drv_cell = bit2driver[bit];
-				if (IsCombinationalGate(drv_cell)) {
-					s_for_check.insert(drv_cell);
-				}
+	}
+
+	// an output port may be an alias of an internal net, so look the ports up through sigmap
+	pool<SigBit> output_bits;
+	for (Wire *wire : module->wires()) {
+		if (wire->port_output) {
+			for (auto bit : sigmap(SigSpec(wire))) {
+				output_bits.insert(bit);
 			}
 		}
 	}
 
-	for (auto &pp : bit2fanout_est) {
-		SigBit bit = pp.first;
-		size_t fo = pp.second;
-		if (bit2fanout_bwd.count(bit)) {
-			bit2fanout_est[bit] = bit2fanout_bwd[bit];
-		} else {
-			bit2fanout_est[bit] = 0; // this bit is not in any cut, maybe is a internal bit
+	std::filesystem::create_directories(dir);
+	std::ofstream manifest(dir + "/" + SHARD_MANIFEST);
+	if (!manifest) {
+		log_error("can not write %s/%s\n", dir.c_str(), SHARD_MANIFEST);
+	}
+	int num_written = 0;
+	for (size_t s = 0; s < shards.size(); s++) {
+		if (shards[s].empty()) {
+			continue;
 		}
-		for (auto reader : bit2reader[bit]) {
-			bit2fanout_est[bit] += IsGTP(reader);
+		string file = stringf("shard_%d.il", num_written++);
+		manifest << "shard " << file << "\n";
+
+		Design *shard_design = new Design;
+		Module *shard = shard_design->addModule(ID(shard));
+		dict<SigBit, SigBit> bit_map;
+		int num_ports = 0;
+		auto map_bit = [&](SigBit bit) -> SigBit {
+			if (!bit.wire) {
+				return bit;
+			}
+			// GTP_ZERO/GTP_ONE outputs go in as literals so the shard sweep can still fold them
+			if (bit2driver.count(bit) && (bit2driver.at(bit)->type == ID(GTP_ZERO) || bit2driver.at(bit)->type == ID(GTP_ONE))) {
+				return SigBit(bit2driver.at(bit)->type == ID(GTP_ONE) ? State::S1 : State::S0);
+			}
+			if (!bit_map.count(bit)) {
+				bool is_input = !bit2driver.count(bit) || !gate2shard.count(bit2driver.at(bit));
+				bool is_output = !is_input && output_bits.count(bit);
+				if (!is_input && bit2reader.count(bit)) {
+					for (Cell *reader : bit2reader.at(bit)) {
+						is_output |= !gate2shard.count(reader) || gate2shard.at(reader) != int(s);
+					}
+				}
+				Wire *wire;
+				if (is_input || is_output) {
+					wire = shard->addWire(stringf("\\%s_%d", is_input ? "in" : "out", num_ports++));
+					wire->port_input = is_input;
+					wire->port_output = is_output;
+					manifest << "port " << wire->name.str() << " " << bit.wire->name.str() << " " << bit.offset << "\n";
+				} else {
+					wire = shard->addWire(NEW_ID);
+				}
+				bit_map[bit] = wire;
+			}
+			return bit_map.at(bit);
+		};
+		for (Cell *gate : shards[s]) {
+			Cell *copy = shard->addCell(gate->name, gate->type);
+			copy->parameters = gate->parameters;
+			for (auto &conn : gate->connections()) {
+				SigSpec sig;
+				for (auto bit : sigmap(conn.second)) {
+					sig.append(map_bit(bit));
+				}
+				copy->setPort(conn.first, sig);
+			}
+			manifest << "cell " << gate->name.str() << "\n";
 		}
+		shard->fixup_ports();
+		Pass::call(shard_design, "write_rtlil " + dir + "/" + file);
+		delete shard_design;
+		log("shard %s: %ld gates, %d ports\n", file.c_str(), shards[s].size(), num_ports);
 	}
-	bit2cut.clear();
-	for (auto &p : map_result) {
-		bit2cut[p.first] = p.second;
+	log("exported %ld gates in %ld regions to %d shards in %s\n", gates.size(), regions.size(), num_written, dir.c_str());
+}
+
+// worker side, maps one shard file and writes <file>.mapped
+void MapShard(const string &file)
+{
+	Design *shard_design = new Design;
+	Pass::call(shard_design, "read_rtlil " + file);
+	Module *shard = shard_design->top_module();
+	if (shard == nullptr) {
+		log_error("%s does not contain a shard module\n", file.c_str());
 	}
-	return true;
+	MapperInit(shard);
+	MapperMain(shard);
+	Pass::call(shard_design, "write_rtlil " + file + ".mapped");
+	delete shard_design;
 }
-// evaluate SigBit out is true or false base on inputs(bit_map)
-State StateEval(dict<SigBit, State> &bit_map, SigBit out)
+
+// replace the gates of every shard listed in the manifest by its mapped netlist
+void ImportShards(Module *module, const string &dir)
 {
-	if (bit_map.count(out)) {
-		return bit_map[out];
+	std::ifstream manifest(dir + "/" + SHARD_MANIFEST);
+	if (!manifest) {
+		log_error("can not read %s/%s\n", dir.c_str(), SHARD_MANIFEST);
 	}
-	Cell *cell = bit2driver[out];
-	if (!cell) {
-		return State::Sx;
+	struct ShardRecord {
+		string file;
+		dict<IdString, SigBit> ports;
+		vector<IdString> cells;
+	};
+	vector<ShardRecord> records;
+	string line;
+	while (std::getline(manifest, line)) {
+		std::istringstream fields(line);
+		string kind, name;
+		fields >> kind >> name;
+		if (kind == "shard") {
+			records.push_back({name, {}, {}});
+		} else if (kind == "port" && !records.empty()) {
+			string wire_name;
+			int offset;
+			fields >> wire_name >> offset;
+			Wire *wire = module->wire(wire_name);
+			if (wire == nullptr || offset >= wire->width) {
+				log_error("shard %s refers to missing wire %s\n", records.back().file.c_str(), wire_name.c_str());
+			}
+			records.back().ports[name] = SigBit(wire, offset);
+		} else if (kind == "cell" && !records.empty()) {
+			records.back().cells.push_back(name);
+		}
 	}
 
-	vector<SigBit> bits = cell2bits[cell];
-	if (IsAND(cell)) {
-		SigBit tout = bits[0];
-		for (size_t i = 1; i < bits.size(); i++) {
-			State tmp = StateEval(bit_map, bits[i]);
-			if (tmp == State::S0) {
-				bit_map[tout] = State::S0;
-				return State::S0;
-			} else if (tmp == State::S1) {
-				continue;
-			} else {
-				log_error("Cannot evaluate %s \n", log_signal(tout));
-				bit_map[tout] = State::Sx;
-				return State::Sx;
-			}
+	int num_cells = 0;
+	for (auto &record : records) {
+		Design *shard_design = new Design;
+		Pass::call(shard_design, "read_rtlil " + dir + "/" + record.file + ".mapped");
+		Module *shard = shard_design->top_module();
+		if (shard == nullptr) {
+			log_error("%s/%s.mapped does not contain a shard module\n", dir.c_str(), record.file.c_str());
 		}
-		return State::S1;
-	} else if (IsOR(cell)) {
-		SigBit tout = bits[0];
-		for (size_t i = 1; i < bits.size(); i++) {
-			State tmp = StateEval(bit_map, bits[i]);
-			if (tmp == State::S1) {
-				bit_map[tout] = State::S1;
-				return State::S1;
-			} else if (tmp == State::S0) {
-				continue;
-			} else {
-				log_error("Cannot evaluate %s \n", log_signal(tout));
-				bit_map[tout] = State::Sx;
-				return State::Sx;
+		for (auto &name : record.cells) {
+			Cell *gate = module->cell(name);
+			if (gate == nullptr) {
+				log_error("gate %s of %s is no longer in module %s\n", name.c_str(), record.file.c_str(), log_id(module));
 			}
+			module->remove(gate);
 		}
-		return State::S0;
-	} else if (IsNOT(cell)) {
-		SigBit tout = bits[0];
-		State tmp = StateEval(bit_map, bits[1]);
-		if (tmp == State::S0) {
-			bit_map[tout] = State::S1;
-			return State::S1;
-		} else if (tmp == State::S1) {
-			bit_map[tout] = State::S0;
-			return State::S0;
-		} else {
-			log_error("Cannot evaluate %s \n", log_signal(tout));
-		}
-	} else if (IsMUX(cell)) {
-		SigBit tout = bits[0];
-		SigSpec sig = cell->getPort(ID(S));
-		sig = sigmap(sig);
-		log_assert(sig.size());
-		SigBit sel_bit = sig[0];
-		sig = cell->getPort(ID(A));
-		sig = sigmap(sig);
-		log_assert(sig.size());
-		SigBit i0_bit = sig[0];
-		sig = cell->getPort(ID(B));
-		sig = sigmap(sig);
-		log_assert(sig.size());
-		SigBit i1_bit = sig[0];
-		State sel_state = StateEval(bit_map, sel_bit);
-		if (sel_state == State::S0) {
-			State tmp = StateEval(bit_map, i0_bit);
-			bit_map[tout] = tmp;
-			return tmp;
-		} else if (sel_state == State::S1) {
-			State tmp = StateEval(bit_map, i1_bit);
-			bit_map[tout] = tmp;
-			return tmp;
+		dict<Wire *, Wire *> wire_map;
+		auto map_sig = [&](const SigSpec &sig) {
+			SigSpec mapped;
+			for (auto bit : sig) {
+				if (bit.wire && record.ports.count(bit.wire->name)) {
+					mapped.append(record.ports.at(bit.wire->name));
+				} else if (bit.wire) {
+					if (!wire_map.count(bit.wire)) {
+						wire_map[bit.wire] = module->addWire(NEW_ID, bit.wire->width);
+					}
+					mapped.append(SigBit(wire_map.at(bit.wire), bit.offset));
+				} else {
+					mapped.append(bit);
+				}
+			}
+			return mapped;
+		};
+		for (Cell *cell : shard->cells()) {
+			Cell *copy = module->addCell(module->uniquify(cell->name), cell->type);
+			copy->parameters = cell->parameters;
+			for (auto &conn : cell->connections()) {
+				copy->setPort(conn.first, map_sig(conn.second));
+			}
+			num_cells++;
 		}
-	} else if (IsXOR(cell)) {
-		SigBit tout = bits[0];
-		State tmp0 = StateEval(bit_map, bits[1]);
-		State tmp1 = StateEval(bit_map, bits[2]);
-		if (tmp0 == State::Sx || tmp1 == State::Sx) {
-			log_error("Cannot evaluate %s \n", log_signal(tout));
-			bit_map[tout] = State::Sx;
-			return State::Sx;
-		} else if (tmp0 == tmp1) {
-			bit_map[tout] = State::S0;
-			return State::S0;
-		} else {
-			bit_map[tout] = State::S1;
-			return State::S1;
+		for (auto &conn : shard->connections()) {
+			module->connect(map_sig(conn.first), map_sig(conn.second));
 		}
-	} else {
-		log_error("unhandled cell %s \n", cell->type.c_str());
+		delete shard_design;
 	}
-	return State::Sx;
+	log("imported %d cells from %ld shards in %s\n", num_cells, records.size(), dir.c_str());
 }
 
-vector<bool> GetCutInit(const vector<SigBit> &cut, SigBit out)
+IdString GetLutType(size_t size)
 {
-	log_assert(cut.size() <= LUT_SIZE && cut.size() >= 1);
-	size_t bits_num = size_t(1 << cut.size());
-	vector<bool> cut_init(bits_num, false);
-	for (size_t i = 0; i < bits_num; i++) {
-		dict<SigBit, State> bit_map;
-		for (size_t n = 0; n < cut.size(); n++)
-			bit_map[cut[n]] = ((i >> n) & 1) ? State::S1 : State::S0;
-
-		State value = StateEval(bit_map, out);
-		if (value == State::Sx) {
-			log_error("Cannot evaluate %s \n", log_signal(out));
-		}
-		cut_init[i] = value == State::S1;
-	}
-	return cut_init;
+	IdString types[] = {ID(GTP_LUT1), ID(GTP_LUT2), ID(GTP_LUT3), ID(GTP_LUT4), ID(GTP_LUT5), ID(GTP_LUT6), ID(GTP_LUT7), ID(GTP_LUT8)};
+	log_assert(size >= 1 && size <= 8);
+	return types[size - 1];
 }
 
-RTLIL::Cell *addLut(Module *module, const pool<SigBit> &cut, const RTLIL::SigBit &sig_z)
+RTLIL::Cell *addLut(Module *module, uint32_t cut, const RTLIL::SigBit &sig_z)
 {
-	log_assert(cut.size() <= LUT_SIZE && cut.size() >= 1);
-	vector<SigBit> vcut;
-	for (auto bit : cut) {
-		vcut.push_back(bit);
+	vector<SigBit> vcut = GetCutLeaves(cut);
+	log_assert(vcut.size() <= LUT_SIZE && vcut.size() >= 1);
+	// with structural choices the function must be evaluated through the cone the cut was built on
+	Cell *root = bit2driver.at(sig_z);
+	const pool<Cell *> *cone = nullptr;
+	if (!bit2choices.empty() && cell2cuts.count(root)) {
+		cone = &cell2cuts.at(root).at(cut);
 	}
-	vector<bool> cut_init_bools = GetCutInit(vcut, sig_z);
+	vector<bool> cut_init_bools = GetCutInit(vcut, sig_z, cone);
 	Cell *drv = bit2driver[sig_z];
 	log_assert(drv);
 	IdString name = drv->name;
-	string new_name = string(name.c_str()) + "_lut";
+	IdString new_name = module->uniquify(string(name.c_str()) + "_lut");
 	Cell *cell = nullptr;
 	if (using_internel_lut_type) {
 		// instantiate $lut, need call techmap pass
-		cell = module->addCell(IdString(new_name), ID($lut));
+		cell = module->addCell(new_name, ID($lut));
 		cell->parameters[ID::WIDTH] = RTLIL::Const(vcut.size());
 		cell->parameters[ID::LUT] = RTLIL::Const(cut_init_bools);
 
@@ -2657,8 +4811,7 @@ RTLIL::Cell *addLut(Module *module, const pool<SigBit> &cut, const RTLIL::SigBit
 		cell->setPort(ID(Y), sig_z);
 		cell->set_src_attribute(drv->get_src_attribute());
 	} else {
-		IdString types[] = {ID(GTP_LUT1), ID(GTP_LUT2), ID(GTP_LUT3), ID(GTP_LUT4), ID(GTP_LUT5), ID(GTP_LUT6)};
-		cell = module->addCell(RTLIL::IdString(new_name), types[vcut.size() - 1]);
+		cell = module->addCell(new_name, GetLutType(vcut.size()));
 		cell->parameters[ID::INIT] = RTLIL::Const(cut_init_bools);
 		for (size_t i = 0; i < vcut.size(); ++i) {
 			string pin_name = "\\I" + to_string(i);
@@ -2670,20 +4823,24 @@ RTLIL::Cell *addLut(Module *module, const pool<SigBit> &cut, const RTLIL::SigBit
 	return cell;
 }
 // map selected cut in bit2cut to GTP_LUT
-bool ConeToLUTs(Module *module, dict<SigBit, pool<SigBit>> &bit2cut)
+bool ConeToLUTs(Module *module, dict<SigBit, uint32_t> &bit2cut)
 {
 	static size_t vf_count = 0;
+	// collect the covered nodes first, in remap mode the new GTP_LUTs are mappable nodes as well
+	vector<Cell *> gates_to_remove;
+	for (auto c : module->cells_) {
+		if (IsCombinationalGate(c.second)) {
+			gates_to_remove.push_back(c.second);
+		}
+	}
 	for (auto &p : bit2cut) {
 		vf_count++;
 		SigBit out = p.first;
-		pool<SigBit> cut = p.second;
-		Cell *lut = addLut(module, cut, out);
+		Cell *lut = addLut(module, p.second, out);
 		log_assert(lut);
 	}
-	for (auto c : module->cells_) {
-		if (IsCombinationalGate(c.second)) {
-			module->remove(c.second);
-		}
+	for (Cell *gate : gates_to_remove) {
+		module->remove(gate);
 	}
 	return true;
 }
@@ -2744,6 +4901,19 @@ bool CheckCellWidth(Module *module) //建表
 		}
 		cell2bits[cell] = all_bits;
 	}
+
+	// number every bit seen by a cell, id 0 is kept for the sentinel leaf
+	id2bit.clear();
+	bit2id.clear();
+	id2bit.push_back(SigBit());
+	for (auto &it : cell2bits) {
+		for (auto &bit : it.second) {
+			if (!bit2id.count(bit)) {
+				bit2id[bit] = id2bit.size();
+				id2bit.push_back(bit);
+			}
+		}
+	}
 	return true;
 }
 
@@ -2754,12 +4924,84 @@ struct MapperPass : public Pass {
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
 		log("\n");
 		log("    mapper [options] [selection]\n");
+		log("\n");
+		log("    -ilut\n");
+		log("        map to internal $lut cells instead of GTP_LUTn.\n");
+		log("\n");
+		log("    -interation <n>\n");
+		log("        number of area recovery iterations (at least 3).\n");
+		log("\n");
+		log("    -portfolio <n>\n");
+		log("        run n differently tuned mapping strategies on parallel threads and keep\n");
+		log("        the cover with the lowest score.cc cost.\n");
+		log("\n");
+		log("    -choices\n");
+		log("        add delay balanced versions of AND/OR/XOR trees as structural choices.\n");
+		log("        equivalent nodes are found by simulation and proven with SAT, cuts are\n");
+		log("        then enumerated across both versions.\n");
+		log("\n");
+		log("    -critical\n");
+		log("        after mapping, re-cover the LUTs on max_level paths and their fanin window\n");
+		log("        with a larger cut budget, repeated while max_level drops without raising\n");
+		log("        the score.cc cost.\n");
+		log("\n");
+		log("    -exact\n");
+		log("        try to rebuild up to 64 windows on max_level paths, each with at most 10\n");
+		log("        inputs. A window with at most -k inputs becomes one LUT. A larger window\n");
+		log("        becomes a depth 2 network with at most 3 bottom LUTs, searched with SAT\n");
+		log("        under a conflict budget. This is not general exact synthesis: deeper\n");
+		log("        networks are never tried, and a window is skipped when the budget runs\n");
+		log("        out. The rebuilt windows are kept only when the score.cc cost drops.\n");
+		log("\n");
+		log("    -exact-budget <n>\n");
+		log("        conflict budget of each exact synthesis SAT call (default 20000).\n");
+		log("\n");
+		log("    -k <n>\n");
+		log("        map to LUTs with at most n inputs, 4 to 8 (default 6). 7 and 8 use the\n");
+		log("        GTP_LUT7/GTP_LUT8 primitives.\n");
+		log("\n");
+		log("    -order <topo|dfs|rcm>\n");
+		log("        renumber the gates inside each topological level in DFS or reverse\n");
+		log("        Cuthill-McKee order so fanins are stored close to their readers.\n");
+		log("        default is topo, the plain topological order.\n");
+		log("\n");
+		log("    -remap\n");
+		log("        also treat GTP_LUT1..8 cells as mappable nodes, so an already mapped\n");
+		log("        netlist is re-covered and chains of small LUTs collapse into fewer LUTs.\n");
+		log("        -k must be at least the width of the widest GTP_LUT in the netlist.\n");
+		log("\n");
+		log("    -export-shards <dir> <n>\n");
+		log("        split the combinational regions between registers and ports into <n>\n");
+		log("        shard files in <dir> instead of mapping. The design is not changed,\n");
+		log("        the shards refer to its gate and wire names and are swept when mapped.\n");
+		log("\n");
+		log("    -shard <file>\n");
+		log("        map one shard file with the other options given and write the result\n");
+		log("        to <file>.mapped, no design is needed. For example:\n");
+		log("            ls dir/shard_*.il | xargs -P 8 -I{} yosys -p 'mapper -shard {}'\n");
+		log("\n");
+		log("    -import-shards <dir>\n");
+		log("        replace the exported gates by the mapped shards of <dir>.\n");
+		log("\n");
 	}
 	bool write_out_black_list;
-	void clear_flags() override { write_out_black_list = false; }
+	string export_dir;
+	int num_shards;
+	string shard_file;
+	string import_dir;
+	void clear_flags() override
+	{
+		ResetMapperOptions();
+		write_out_black_list = false;
+		export_dir.clear();
+		num_shards = 1;
+		shard_file.clear();
+		import_dir.clear();
+	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		log_header(design, "Start MapperPass\n");
+		clear_flags();
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
@@ -2771,17 +5013,83 @@ struct MapperPass : public Pass {
 				MAX_INTERATIONS = max(atoi(args[++argidx].c_str()), 3);
 				continue;
 			}
+			if (args[argidx] == "-portfolio" && argidx + 1 < args.size()) {
+				PORTFOLIO_SIZE = max(atoi(args[++argidx].c_str()), 1);
+				continue;
+			}
+			if (args[argidx] == "-choices") {
+				use_choices = true;
+				continue;
+			}
+			if (args[argidx] == "-critical") {
+				critical_resynthesis = true;
+				continue;
+			}
+			if (args[argidx] == "-exact") {
+				exact_synthesis = true;
+				continue;
+			}
+			if (args[argidx] == "-exact-budget" && argidx + 1 < args.size()) {
+				EXACT_CONFLICT_BUDGET = max(atoll(args[++argidx].c_str()), 1LL);
+				continue;
+			}
+			if (args[argidx] == "-k" && argidx + 1 < args.size()) {
+				LUT_SIZE = atoi(args[++argidx].c_str());
+				if (LUT_SIZE < 4 || LUT_SIZE > 8)
+					log_cmd_error("LUT size must be between 4 and 8.\n");
+				continue;
+			}
+			if (args[argidx] == "-order" && argidx + 1 < args.size()) {
+				string order = args[++argidx];
+				if (order == "topo")
+					GATE_ORDER = ORDER_TOPO;
+				else if (order == "dfs")
+					GATE_ORDER = ORDER_DFS;
+				else if (order == "rcm")
+					GATE_ORDER = ORDER_RCM;
+				else
+					log_cmd_error("Unknown gate order '%s'.\n", order.c_str());
+				continue;
+			}
+			if (args[argidx] == "-remap") {
+				remap_luts = true;
+				continue;
+			}
+			if (args[argidx] == "-export-shards" && argidx + 2 < args.size()) {
+				export_dir = args[++argidx];
+				num_shards = max(atoi(args[++argidx].c_str()), 1);
+				continue;
+			}
+			if (args[argidx] == "-shard" && argidx + 1 < args.size()) {
+				shard_file = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-import-shards" && argidx + 1 < args.size()) {
+				import_dir = args[++argidx];
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
 
+		if (!shard_file.empty()) {
+			MapShard(shard_file);
+			log_pop();
+			return;
+		}
+
 		Module *module = design->top_module();
 		if (module == nullptr)
 			log_cmd_error("No top module found.\n");
 
 		log_header(design, "Continuing MapperPass pass.\n");
 		MapperInit(module);
-		MapperMain(module);
+		if (!export_dir.empty())
+			ExportShards(module, export_dir, num_shards);
+		else if (!import_dir.empty())
+			ImportShards(module, import_dir);
+		else
+			MapperMain(module);
 		log_pop();
 	}
 } MapperPass;
@@ -2800,7 +5108,7 @@ struct SynthPangoPass : public ScriptPass {
 	string top_module_name;
 	void clear_flags() override
 	{
-		using_internel_lut_type = false;
+		ResetMapperOptions();
 		output_verilog_file = "";
 		top_module_name = "";
 	}
@@ -0,0 +1,13 @@
+// output ports that become aliases of internal nets after the mapper sweep:
+// y0 is a double inversion of n0 (which also feeds y2), y1 is a buffer of n2
+module shard_alias(a, b, c, d, y0, y1, y2);
+  input a, b, c, d;
+  output y0, y1, y2;
+  wire n0, n1, n2;
+  \$_AND_ g0 (.A(a), .B(b), .Y(n0));
+  \$_NOT_ g1 (.A(n0), .Y(n1));
+  \$_NOT_ g2 (.A(n1), .Y(y0));
+  \$_XOR_ g3 (.A(n0), .B(c), .Y(y2));
+  \$_OR_ g4 (.A(c), .B(d), .Y(n2));
+  \$_BUF_ g5 (.A(n2), .Y(y1));
+endmodule
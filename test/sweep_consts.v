@@ -0,0 +1,27 @@
+// gates that the mapper sweep folds before cut enumeration:
+// constant inputs (g0..g4), a double inversion (g5, g6), a mux with a constant
+// select (g7), logic that drives nothing (g8, g9) and a register fed by the
+// swept logic whose output loops back through a double inversion (g10..g12)
+module sweep_consts(clk, a, b, c, d, y0, y1, y2, y3, y4);
+  input clk, a, b, c, d;
+  output y0, y1, y2, y3, y4;
+  wire n0, n1, n2, n3, n4, n5, n6, n7, n8, n9, q, nq0, nq1;
+  \$_AND_ g0 (.A(a), .B(1'b1), .Y(n0));
+  \$_OR_ g1 (.A(b), .B(1'b0), .Y(n1));
+  \$_XOR_ g2 (.A(n0), .B(1'b1), .Y(n2));
+  \$_AND_ g3 (.A(c), .B(1'b0), .Y(n3));
+  \$_OR_ g4 (.A(n3), .B(n1), .Y(n4));
+  \$_NOT_ g5 (.A(n4), .Y(n5));
+  \$_NOT_ g6 (.A(n5), .Y(n6));
+  \$_MUX_ g7 (.A(n2), .B(d), .S(1'b0), .Y(n7));
+  \$_AND_ g8 (.A(a), .B(d), .Y(n8));
+  \$_XOR_ g9 (.A(n8), .B(c), .Y(n9));
+  \$_NOT_ g10 (.A(q), .Y(nq0));
+  \$_NOT_ g11 (.A(nq0), .Y(nq1));
+  \$_XOR_ g12 (.A(nq1), .B(n7), .Y(y3));
+  GTP_DFF #(.GRS_EN("TRUE"), .INIT(1'h0)) r0 (.CLK(clk), .D(n6), .Q(q));
+  \$_AND_ g13 (.A(n6), .B(n7), .Y(y0));
+  \$_OR_ g14 (.A(n3), .B(1'b0), .Y(y1));
+  assign y2 = n5;
+  assign y4 = q;
+endmodule